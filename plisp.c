@@ -2,15 +2,42 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <assert.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <setjmp.h>
 
 #define ALWAYS_GC 0
 
+//set while serving requests, errors then abort the request instead of exiting
+static jmp_buf *error_handler = 0;
+#define QUIT_REQUEST 2  // longjmp value of quit, error uses 1
+static char error_msg[256];
+static void out_flush(void);
+
 static void error(char *fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
+  if(error_handler) {
+    vsnprintf(error_msg, sizeof(error_msg), fmt, ap);
+    va_end(ap);
+    longjmp(*error_handler, 1);
+  }
+  //output printed before the error comes first
+  out_flush();
   fprintf(stderr, "error: ");
   vfprintf(stderr, fmt, ap);
   fprintf(stderr, "\n");
@@ -26,10 +53,12 @@ enum {
   TINT = 1,
   TCELL,
   TSYMBOL,
+  TSTRING,
   TPRIMITIVE,
   TFUNCTION,
   TMACRO,
   TENV,
+  TSTREAM,
   TTRUE,
   TNIL,
   TDOT,
@@ -40,9 +69,9 @@ struct obj_t;
 typedef struct obj_t *primitive(void *root, struct obj_t **env, struct obj_t **args);
 
 typedef struct obj_t {
-  int type;
-  unsigned int size;
-  unsigned char gc_r; // used by gc
+  unsigned char type;
+  unsigned char sclass; // size class of the slot holding obj, 0 if not on the heap
+  unsigned char on_path;  // cell is on the path of print_cyclic
 
   union {
     int value;      //Int
@@ -50,19 +79,41 @@ typedef struct obj_t {
       struct obj_t *car;
       struct obj_t *cdr;
     };
-    char name[1];     //Symbol
+    struct {        //Symbol
+      unsigned char local;  // ever bound outside the global frame
+      char name[1];
+    };
+    struct {        //String
+      struct obj_t *owner;  // object keeping chars alive
+      char *chars;
+      size_t len;
+      unsigned char mapped; // chars is a mapped file
+      char text[1];         // chars of strings owning their data
+    };
     primitive *fn;  //Primative
 
     struct {        //Function
       struct obj_t *params;
       struct obj_t *body;
       struct obj_t *env;
+      struct jit_t *jit;  // native code, see JIT
+      int calls;
     };
 
     struct {        //Env frame
       struct obj_t *vars;
       struct obj_t *up;
     };
+
+    struct {        //Stream
+      struct obj_t *src;    // source data or the stream pulled from
+      struct obj_t *proc;   // function of map, filter and iterate
+      struct obj_t *args;   // argument list reused for every call of proc
+      long pos;             // offset, count of pulls or elements left
+      long end;
+      long step;
+      int kind;
+    };
   };
 } obj_t;
 
@@ -76,6 +127,29 @@ static obj_t *Cparen  = &(obj_t) { TCPAREN };
 //list containing all symbols
 static obj_t *symbols;
 
+//native code of a function together with the global bindings it was compiled against
+#define JIT_MAX_PARAMS 16
+#define JIT_MAX_GUARDS 32
+
+typedef struct jit_guard_t {
+  obj_t *sym;
+  obj_t *bind;
+  obj_t *value;
+} jit_guard_t;
+
+typedef struct jit_t {
+  int (*code)(long *args);
+  size_t size;
+  int nparams;
+  int kind;
+  int nguards;
+  unsigned long version;  // global_version the guards were last checked at
+  struct obj_t *stamp;    // stamp of the optimized body compiled, or 0
+  jit_guard_t guards[JIT_MAX_GUARDS];
+} jit_t;
+
+static void jit_free(jit_t *jit);
+
 //---------------------------------------- 
 // Memory management | GC
 //---------------------------------------- 
@@ -112,29 +186,211 @@ static obj_t *symbols;
   obj_t **var3 = (obj_t**)(root_ADD_ROOT_ + 3); \
   obj_t **var4 = (obj_t**)(root_ADD_ROOT_ + 4); \
 
+#define DEFINE5(var1, var2, var3, var4, var5)   \
+  ADD_ROOT(5);                                  \
+  obj_t **var1 = (obj_t**)(root_ADD_ROOT_ + 1); \
+  obj_t **var2 = (obj_t**)(root_ADD_ROOT_ + 2); \
+  obj_t **var3 = (obj_t**)(root_ADD_ROOT_ + 3); \
+  obj_t **var4 = (obj_t**)(root_ADD_ROOT_ + 4); \
+  obj_t **var5 = (obj_t**)(root_ADD_ROOT_ + 5); \
+
 #define MAX_MEM 8096
+#define GC_MAX_THREADS 64
+#define GC_STEAL_MAX 256
+#define GC_CHUNK 64
+#define GC_THREAD_REGIONS 4
+
+//the heap is made of aligned regions that each hold objs of one size class,
+//alloc and mark bits live in bitmaps at the start of the region
+#define REGION_SIZE (64 * 1024)
+#define REGION_WORDS (REGION_SIZE / 16 / 64)
+#define SCLASS_COUNT 16
+#define SCLASS_LARGE 255
+
+static const unsigned int sclass_size[SCLASS_COUNT] = {
+  0, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
+typedef struct region_t {
+  struct region_t *next;
+  char *objs;
+  unsigned int slot;    // bytes per obj
+  unsigned int nslots;
+  unsigned int bump;    // slots never handed out start here
+  obj_t *free;          // swept slots, linked through car
+  uint64_t alloc[REGION_WORDS];
+  uint64_t mark[REGION_WORDS];
+} region_t;
+
+//objs bigger than any class get their own allocation behind a small header
+typedef struct large_t {
+  struct large_t *next;
+  size_t size;
+  unsigned char mark;
+} large_t;
+
+#define REGION_HEADER ((sizeof(region_t) + 15) & ~(size_t)15)
+#define LARGE_HEADER ((sizeof(large_t) + 15) & ~(size_t)15)
+
+static region_t *regions[SCLASS_COUNT];
+static region_t *region_tail[SCLASS_COUNT];
+static region_t *region_cursor[SCLASS_COUNT];  // first region that may have room
+static unsigned long region_count = 0;
+static large_t *large_objs;
+
+static inline region_t *region_of(obj_t *obj) {
+  return (region_t*)((uintptr_t)obj & ~(uintptr_t)(REGION_SIZE - 1));
+}
+
+static inline large_t *large_of(obj_t *obj) {
+  return (large_t*)((char*)obj - LARGE_HEADER);
+}
+
+static int sclass_for(size_t size) {
+  for(int c = 1; c < SCLASS_COUNT; c++)
+    if(size <= sclass_size[c])
+      return c;
+  return SCLASS_LARGE;
+}
+
+static region_t *region_new(int sclass) {
+  region_t *r = aligned_alloc(REGION_SIZE, REGION_SIZE);
+  if(!r) {
+    error("allocation failed");
+    exit(0);
+  }
+  memset(r, 0, REGION_HEADER);
+  r->objs = (char*)r + REGION_HEADER;
+  r->slot = sclass_size[sclass];
+  r->nslots = (REGION_SIZE - REGION_HEADER) / r->slot;
+  if(region_tail[sclass])
+    region_tail[sclass]->next = r;
+  else
+    regions[sclass] = r;
+  region_tail[sclass] = r;
+  region_count++;
+  return r;
+}
+
+static obj_t *alloc_slot(int sclass) {
+  region_t *r = region_cursor[sclass];
+  while(r && !r->free && r->bump == r->nslots)
+    r = r->next;
+  if(!r)
+    r = region_new(sclass);
+  region_cursor[sclass] = r;
 
-typedef struct obj_list_t {
   obj_t *obj;
-  struct obj_list_t *next;
-} obj_list_t;
-obj_list_t *obj_list = 0;
+  size_t i;
+  if(r->free) {
+    obj = r->free;
+    r->free = obj->car;
+    i = ((char*)obj - r->objs) / r->slot;
+  } else {
+    i = r->bump++;
+    obj = (obj_t*)(r->objs + i * r->slot);
+  }
+  r->alloc[i / 64] |= (uint64_t)1 << (i % 64);
+  return obj;
+}
 
-void obj_list_add(obj_t *obj) {
-  obj_list_t *temp = malloc(sizeof(obj_list_t));
-  if(!temp) {
+static obj_t *alloc_large(size_t size) {
+  large_t *l = malloc(LARGE_HEADER + size);
+  if(!l) {
     error("allocation failed");
     exit(0);
   }
-  temp->obj = obj;
-  temp->next = obj_list;
-  obj_list = temp;
+  l->size = size;
+  l->mark = 0;
+  l->next = large_objs;
+  large_objs = l;
+  return (obj_t*)((char*)l + LARGE_HEADER);
+}
+
+size_t mem_used = 0;
+static size_t max_mem = MAX_MEM;
+static int gc_threads = 1;
+static int print_stats = 0;
+
+//gc statistics, reported on exit
+static unsigned long gc_count = 0;
+static double gc_pause_total = 0;
+static double gc_pause_max = 0;
+//collections and pause total by the number of threads that ran them
+static unsigned long gc_count_by[GC_MAX_THREADS + 1];
+static double gc_pause_by[GC_MAX_THREADS + 1];
+
+//every gc thread owns a mark stack that only it touches. when it holds
+//plenty of work a chunk is moved to its shared stack, idle threads steal
+//from the shared stacks of the others
+typedef struct mark_stack_t {
+  obj_t **objs;
+  int len;
+  int cap;
+  obj_t **shared;   // guarded by lock
+  int shared_len;   // read without the lock by idle threads
+  int shared_cap;
+  size_t freed;
+  unsigned long seen;  // last pool epoch the owning helper thread ran
+  pthread_mutex_t lock;
+} mark_stack_t;
+
+static mark_stack_t mark_stacks[GC_MAX_THREADS];
+static int gc_workers = 0;
+static int gc_idle = 0;
+
+static void stack_reserve(obj_t ***objs, int *cap, int len) {
+  if(len <= *cap)
+    return;
+  while(*cap < len)
+    *cap = *cap ? *cap * 2 : 256;
+  *objs = realloc(*objs, sizeof(obj_t*) * *cap);
+  if(!*objs)
+    error("allocation failed");
+}
+
+//moves a chunk of work to the shared stack once that ran empty
+static void mark_stack_publish(mark_stack_t *s) {
+  if(s->len < 2 * GC_CHUNK || __atomic_load_n(&s->shared_len, __ATOMIC_RELAXED))
+    return;
+  pthread_mutex_lock(&s->lock);
+  stack_reserve(&s->shared, &s->shared_cap, GC_CHUNK);
+  s->len -= GC_CHUNK;
+  memcpy(s->shared, s->objs + s->len, sizeof(obj_t*) * GC_CHUNK);
+  __atomic_store_n(&s->shared_len, GC_CHUNK, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&s->lock);
+}
+
+static void mark_stack_push(mark_stack_t *s, obj_t *obj) {
+  stack_reserve(&s->objs, &s->cap, s->len + 1);
+  s->objs[s->len++] = obj;
+  if(gc_workers > 1)
+    mark_stack_publish(s);
 }
 
-unsigned int mem_used = 0;
+//sets the mark bit of obj, returns whether it was set already
+static int mark_bit(obj_t *obj) {
+  if(obj->sclass == SCLASS_LARGE) {
+    large_t *l = large_of(obj);
+    return __atomic_load_n(&l->mark, __ATOMIC_RELAXED)
+      || __atomic_exchange_n(&l->mark, 1, __ATOMIC_RELAXED);
+  }
+  region_t *r = region_of(obj);
+  size_t i = ((char*)obj - r->objs) / r->slot;
+  uint64_t *word = &r->mark[i / 64];
+  uint64_t bit = (uint64_t)1 << (i % 64);
+  if(__atomic_load_n(word, __ATOMIC_RELAXED) & bit)
+    return 1;
+  if(gc_workers > 1)
+    return (__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit) != 0;
+  *word |= bit;
+  return 0;
+}
 
-static void mark_obj(obj_t *obj) {
-  obj->gc_r = 1;
+//flags obj and queues it for scanning if it has not been seen yet
+static void mark_obj(mark_stack_t *s, obj_t *obj) {
+  if(!obj->sclass || mark_bit(obj))
+    return;
   switch(obj->type) {
     case TINT:
     case TSYMBOL:
@@ -142,73 +398,319 @@ static void mark_obj(obj_t *obj) {
     case TTRUE:
     case TNIL:
     case TCPAREN:
-      break;
+      return;
+  }
+  mark_stack_push(s, obj);
+}
+
+//moves up to half of the shared work of victim onto the stack of s
+static int mark_take(mark_stack_t *s, mark_stack_t *victim, int all) {
+  if(!__atomic_load_n(&victim->shared_len, __ATOMIC_ACQUIRE))
+    return 0;
+  pthread_mutex_lock(&victim->lock);
+  int n = all ? victim->shared_len : (victim->shared_len + 1) / 2;
+  if(n > GC_STEAL_MAX)
+    n = GC_STEAL_MAX;
+  int left = victim->shared_len - n;
+  stack_reserve(&s->objs, &s->cap, s->len + n);
+  memcpy(s->objs + s->len, victim->shared + left, sizeof(obj_t*) * n);
+  s->len += n;
+  __atomic_store_n(&victim->shared_len, left, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&victim->lock);
+  return n > 0;
+}
+
+static int mark_stack_pop(mark_stack_t *s, obj_t **obj) {
+  if(!s->len && (gc_workers == 1 || !mark_take(s, s, 1)))
+    return 0;
+  *obj = s->objs[--s->len];
+  return 1;
+}
+
+static int mark_steal(mark_stack_t *s) {
+  for(int i = 1; i < gc_workers; i++)
+    if(mark_take(s, &mark_stacks[(s - mark_stacks + i) % gc_workers], 0))
+      return 1;
+  return 0;
+}
+
+//a thread only goes idle with both of its stacks empty, so only shared
+//work can be left for the others
+static int mark_work_left(void) {
+  for(int i = 0; i < gc_workers; i++)
+    if(__atomic_load_n(&mark_stacks[i].shared_len, __ATOMIC_ACQUIRE))
+      return 1;
+  return 0;
+}
+
+static void scan_obj(mark_stack_t *s, obj_t *obj) {
+  switch(obj->type) {
     case TCELL:
-      mark_obj(obj->car);
-      mark_obj(obj->cdr);
+      mark_obj(s, obj->car);
+      mark_obj(s, obj->cdr);
       break;
     case TFUNCTION:
     case TMACRO:
-      mark_obj(obj->params);
-      mark_obj(obj->body);
-      mark_obj(obj->env);
+      mark_obj(s, obj->params);
+      mark_obj(s, obj->body);
+      mark_obj(s, obj->env);
+      if(obj->jit)
+        for(int i = 0; i < obj->jit->nguards; i++)
+          mark_obj(s, obj->jit->guards[i].value);
       break;
     case TENV:
-      mark_obj(obj->vars);
-      mark_obj(obj->up);
+      mark_obj(s, obj->vars);
+      mark_obj(s, obj->up);
+      break;
+    case TSTRING:
+      mark_obj(s, obj->owner);
+      break;
+    case TSTREAM:
+      mark_obj(s, obj->src);
+      mark_obj(s, obj->proc);
+      mark_obj(s, obj->args);
       break;
     default:
       error("bug marking unknown object %d\n", obj->type);
   }
 }
 
+//marks until every thread runs out of work
+static void mark_loop(mark_stack_t *s) {
+  obj_t *obj;
+  for(;;) {
+    while(mark_stack_pop(s, &obj))
+      scan_obj(s, obj);
+    if(gc_workers == 1)
+      return;
+    if(mark_steal(s))
+      continue;
+    __atomic_add_fetch(&gc_idle, 1, __ATOMIC_SEQ_CST);
+    for(;;) {
+      if(__atomic_load_n(&gc_idle, __ATOMIC_SEQ_CST) == gc_workers)
+        return;
+      if(mark_work_left()) {
+        __atomic_sub_fetch(&gc_idle, 1, __ATOMIC_SEQ_CST);
+        break;
+      }
+      sched_yield();
+    }
+  }
+}
+
+static void free_obj(obj_t *obj) {
+  if(obj->type == TFUNCTION && obj->jit)
+    jit_free(obj->jit);
+  if(obj->type == TSTRING && obj->mapped)
+    munmap(obj->chars, obj->len);
+}
+
+//puts the unmarked objs of a region on its free list and clears the marks
+static size_t sweep_region(region_t *r) {
+  size_t freed = 0;
+  for(unsigned int w = 0; w < (r->bump + 63) / 64; w++) {
+    uint64_t dead = r->alloc[w] & ~r->mark[w];
+    r->alloc[w] = r->mark[w];
+    r->mark[w] = 0;
+    while(dead) {
+      obj_t *obj = (obj_t*)(r->objs + (w * 64 + __builtin_ctzll(dead)) * r->slot);
+      dead &= dead - 1;
+      free_obj(obj);
+      obj->car = r->free;
+      r->free = obj;
+      freed += r->slot;
+    }
+  }
+  return freed;
+}
+
+static size_t sweep_large(void) {
+  size_t freed = 0;
+  for(large_t **l = &large_objs; *l;) {
+    if(!(*l)->mark) {
+      large_t *dead = *l;
+      *l = dead->next;
+      free_obj((obj_t*)((char*)dead + LARGE_HEADER));
+      freed += dead->size;
+      free(dead);
+    } else {
+      (*l)->mark = 0;
+      l = &(*l)->next;
+    }
+  }
+  return freed;
+}
+
+//regions to sweep, split between the threads by index
+static region_t **sweep_list;
+static unsigned long sweep_len = 0;
+static unsigned long sweep_cap = 0;
+
+static void gc_worker(mark_stack_t *s) {
+  mark_loop(s);
+  //marking is done once any thread leaves the mark loop
+  s->freed = 0;
+  for(unsigned long i = s - mark_stacks; i < sweep_len; i += gc_workers)
+    s->freed += sweep_region(sweep_list[i]);
+  if(s == mark_stacks)
+    s->freed += sweep_large();
+}
+
+//the helper threads are started by the first collection and wait for
+//the next one between collections
+static pthread_mutex_t gc_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gc_pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t gc_pool_done = PTHREAD_COND_INITIALIZER;
+static unsigned long gc_pool_epoch = 0;
+static int gc_pool_size = 0;
+static int gc_pool_busy = 0;
+
+static void *gc_pool_thread(void *arg) {
+  mark_stack_t *s = arg;
+  pthread_mutex_lock(&gc_pool_lock);
+  for(;;) {
+    while(gc_pool_epoch == s->seen)
+      pthread_cond_wait(&gc_pool_start, &gc_pool_lock);
+    s->seen = gc_pool_epoch;
+    if(s - mark_stacks >= gc_workers)
+      continue;
+    pthread_mutex_unlock(&gc_pool_lock);
+    gc_worker(s);
+    pthread_mutex_lock(&gc_pool_lock);
+    if(--gc_pool_busy == 0)
+      pthread_cond_signal(&gc_pool_done);
+  }
+  return 0;
+}
+
+//frees empty regions but one per class and restarts allocation at the front
+static void release_regions(void) {
+  for(int c = 1; c < SCLASS_COUNT; c++) {
+    int kept = 0;
+    region_tail[c] = 0;
+    for(region_t **r = &regions[c]; *r;) {
+      int empty = 1;
+      for(int w = 0; w < REGION_WORDS && empty; w++)
+        empty = !(*r)->alloc[w];
+      if(empty && kept) {
+        region_t *dead = *r;
+        *r = dead->next;
+        free(dead);
+        region_count--;
+        continue;
+      }
+      if(empty) {
+        (*r)->bump = 0;
+        (*r)->free = 0;
+        kept = 1;
+      }
+      region_tail[c] = *r;
+      r = &(*r)->next;
+    }
+    region_cursor[c] = regions[c];
+  }
+}
+
 static void gc(void *root) {
-  //walk root and set flag
-  mark_obj(symbols);
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  static int initialized = 0;
+  if(!initialized) {
+    for(int i = 0; i < GC_MAX_THREADS; i++)
+      pthread_mutex_init(&mark_stacks[i].lock, 0);
+    initialized = 1;
+  }
+
+  //small heaps are not worth waking the other threads for
+  gc_workers = region_count / GC_THREAD_REGIONS;
+  if(gc_workers > gc_threads)
+    gc_workers = gc_threads;
+  if(gc_workers < 1)
+    gc_workers = 1;
+  gc_idle = 0;
+
+  //a new thread waits for the epoch after the current one. it is saved
+  //here since the thread may only start after that epoch was broadcast
+  for(; gc_pool_size < gc_workers - 1; gc_pool_size++) {
+    pthread_t thread;
+    mark_stacks[gc_pool_size + 1].seen = gc_pool_epoch;
+    if(pthread_create(&thread, 0, gc_pool_thread, &mark_stacks[gc_pool_size + 1]))
+      error("unable to start gc thread");
+    pthread_detach(thread);
+  }
+
+  if(region_count > sweep_cap) {
+    sweep_cap = region_count * 2;
+    sweep_list = realloc(sweep_list, sizeof(region_t*) * sweep_cap);
+    if(!sweep_list)
+      error("allocation failed");
+  }
+  sweep_len = 0;
+  for(int c = 1; c < SCLASS_COUNT; c++)
+    for(region_t *r = regions[c]; r; r = r->next)
+      sweep_list[sweep_len++] = r;
+
+  //walk root and hand the objects out to the threads
+  int next = 0;
+  mark_obj(&mark_stacks[0], symbols);
   for(void **frame = root; frame; frame = *(void***)frame) {
     for(int i = 1; frame[i] != ROOT_END; i++) {
-      if(frame[i])
-        mark_obj(frame[i]);
+      if(frame[i]) {
+        mark_obj(&mark_stacks[next], frame[i]);
+        next = (next + 1) % gc_workers;
+      }
     }
   }
 
-  //free all objs that have flag set
-  obj_list_t *f_entry = 0;
-  for(obj_list_t **entry = &obj_list; *entry;) {
-    if(!(*entry)->obj->gc_r) {
-      free((*entry)->obj);
-      f_entry = *entry;
-      *entry = (*entry)->next;
-      free(f_entry);
-    } else {
-      (*entry)->obj->gc_r = 0;
-      entry = &((*entry)->next);
-    }
+  if(gc_workers > 1) {
+    pthread_mutex_lock(&gc_pool_lock);
+    gc_pool_busy = gc_workers - 1;
+    gc_pool_epoch++;
+    pthread_cond_broadcast(&gc_pool_start);
+    pthread_mutex_unlock(&gc_pool_lock);
+  }
+  gc_worker(&mark_stacks[0]);
+  if(gc_workers > 1) {
+    pthread_mutex_lock(&gc_pool_lock);
+    while(gc_pool_busy)
+      pthread_cond_wait(&gc_pool_done, &gc_pool_lock);
+    pthread_mutex_unlock(&gc_pool_lock);
   }
+  for(int i = 0; i < gc_workers; i++)
+    mem_used -= mark_stacks[i].freed;
+  release_regions();
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double pause = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+  gc_count++;
+  gc_pause_total += pause;
+  gc_count_by[gc_workers]++;
+  gc_pause_by[gc_workers] += pause;
+  if(pause > gc_pause_max)
+    gc_pause_max = pause;
 }
 
 static obj_t *alloc(void *root, int type, size_t size) {
   size += offsetof(obj_t, value);
+  int sclass = sclass_for(size);
+  if(sclass != SCLASS_LARGE)
+    size = sclass_size[sclass];
 
-  if(size + mem_used >= MAX_MEM || ALWAYS_GC)
+  if(size + mem_used >= max_mem || ALWAYS_GC)
     gc(root);
 
-  if(size + mem_used >= MAX_MEM) {
+  if(size + mem_used >= max_mem) {
     error("memory exhausted");
     exit(0);
   }
 
-  obj_t *obj = malloc(size);
-  if(!obj) {
-    error("allocation failed");
-    exit(0);
-  }
+  obj_t *obj = sclass == SCLASS_LARGE ? alloc_large(size) : alloc_slot(sclass);
   obj->type = type;
-  obj->size = size;
-  obj->gc_r = 0;
+  obj->sclass = sclass;
+  obj->on_path = 0;
 
   mem_used += size;
-  obj_list_add(obj);
 
   return obj;
 }
@@ -231,11 +733,43 @@ static obj_t *cons(void *root, obj_t **car, obj_t **cdr) {
 }
 
 static obj_t *make_symbol(void *root, char *name) {
-  obj_t *obj = alloc(root, TSYMBOL, strlen(name) + 1);
+  obj_t *obj = alloc(root, TSYMBOL, sizeof(unsigned char) + strlen(name) + 1);
+  obj->local = 0;
   strcpy(obj->name, name);
   return obj;
 }
 
+//string of len chars which are not initialized
+static obj_t *make_string(void *root, size_t len) {
+  obj_t *obj = alloc(root, TSTRING, offsetof(obj_t, text) - offsetof(obj_t, value) + len + 1);
+  obj->owner = obj;
+  obj->chars = obj->text;
+  obj->len = len;
+  obj->mapped = 0;
+  obj->chars[len] = 0;
+  return obj;
+}
+
+//string sharing the chars of str
+static obj_t *make_slice(void *root, obj_t **str, size_t start, size_t len) {
+  obj_t *obj = alloc(root, TSTRING, offsetof(obj_t, text) - offsetof(obj_t, value));
+  obj->owner = (*str)->owner;
+  obj->chars = (*str)->chars + start;
+  obj->len = len;
+  obj->mapped = 0;
+  return obj;
+}
+
+//string of a mapped file, the mapping is released with the string
+static obj_t *make_mapped_string(void *root, char *chars, size_t len) {
+  obj_t *obj = alloc(root, TSTRING, offsetof(obj_t, text) - offsetof(obj_t, value));
+  obj->owner = obj;
+  obj->chars = chars;
+  obj->len = len;
+  obj->mapped = len > 0;
+  return obj;
+}
+
 static obj_t *make_primitive(void *root, primitive *fn) {
   obj_t *obj = alloc(root, TPRIMITIVE, sizeof(primitive*));
   obj->fn = fn;
@@ -244,10 +778,12 @@ static obj_t *make_primitive(void *root, primitive *fn) {
 
 static obj_t *make_function(void *root, obj_t **env, int type, obj_t **params, obj_t **body) {
   assert(type == TFUNCTION || type == TMACRO);  
-  obj_t *obj = alloc(root, type, sizeof(obj_t*) * 3);
+  obj_t *obj = alloc(root, type, sizeof(obj_t*) * 3 + sizeof(jit_t*) + sizeof(int));
   obj->params = *params;
   obj->body = *body;
   obj->env = *env;
+  obj->jit = 0;
+  obj->calls = 0;
   return obj;
 }
 
@@ -258,6 +794,28 @@ static obj_t *make_env(void *root, obj_t **vars, obj_t **up) {
   return obj;
 }
 
+enum {
+  STREAM_LIST,
+  STREAM_RANGE,
+  STREAM_LINES,
+  STREAM_ITERATE,
+  STREAM_MAP,
+  STREAM_FILTER,
+  STREAM_TAKE,
+};
+
+static obj_t *make_stream(void *root, int kind, obj_t **src, obj_t **proc, obj_t **args) {
+  obj_t *obj = alloc(root, TSTREAM, sizeof(obj_t*) * 3 + sizeof(long) * 3 + sizeof(int));
+  obj->src = *src;
+  obj->proc = *proc;
+  obj->args = *args;
+  obj->pos = 0;
+  obj->end = 0;
+  obj->step = 0;
+  obj->kind = kind;
+  return obj;
+}
+
 // ((x . y) . a)
 static obj_t *acons(void *root, obj_t **x, obj_t **y, obj_t **a) {
   DEFINE1(cell);
@@ -274,9 +832,16 @@ const char symbol_chars[] = "~!@#$&^&*-_=+:/?<>";
 
 static obj_t *read_exp(void *root);
 
+//source of the reader
+static FILE *input;
+
+static int next_char(void) {
+  return getc(input);
+}
+
 static int peek(void) {
-  int c = getchar();
-  ungetc(c, stdin);
+  int c = getc(input);
+  ungetc(c, input);
   return c;
 }
 
@@ -293,12 +858,12 @@ static obj_t *reverse(obj_t *p) {
 
 static void skip_line(void) {
   for(;;) {
-    int c = getchar();
+    int c = next_char();
     if(c == EOF ||c == '\n')
       return;
     if(c == '\r') {
       if(peek() == '\n')
-        getchar();
+        next_char();
       return;
     }
   }
@@ -320,7 +885,7 @@ static obj_t *read_list(void *root) {
         error("close paranthesis expected after dot");
       obj_t *ret = reverse(*head);
       (*head)->cdr = *last;
-      return *last;
+      return ret;
     }
     *head = cons(root, obj, head);
   }
@@ -349,7 +914,7 @@ static obj_t *read_quote(void *root) {
 
 static int read_number(int val) {
   while(isdigit(peek()))
-    val = val * 10 + (getchar() - '0');
+    val = val * 10 + (next_char() - '0');
   return val;
 }
 
@@ -360,15 +925,52 @@ static obj_t *read_symbol(void *root, char c) {
   while(isalnum(peek()) || strchr(symbol_chars, peek())) {
     if(SYMBOL_MAX_LEN <= len)
       error("symbol name too long");
-    buf[len++] = getchar();
+    buf[len++] = next_char();
   }
   buf[len] = 0;
   return intern(root, buf);
 }
 
+// '"' has already been read
+static obj_t *read_string(void *root) {
+  size_t len = 0, cap = 64;
+  char *buf = malloc(cap);
+  if(!buf)
+    error("allocation failed");
+  for(;;) {
+    int c = next_char();
+    if(c == '"')
+      break;
+    if(c == '\\') {
+      c = next_char();
+      if(c == 'n')
+        c = '\n';
+      else if(c == 't')
+        c = '\t';
+    }
+    if(c == EOF) {
+      free(buf);
+      error("unclosed string");
+    }
+    if(len == cap) {
+      char *grown = realloc(buf, cap *= 2);
+      if(!grown) {
+        free(buf);
+        error("allocation failed");
+      }
+      buf = grown;
+    }
+    buf[len++] = c;
+  }
+  obj_t *str = make_string(root, len);
+  memcpy(str->chars, buf, len);
+  free(buf);
+  return str;
+}
+
 static obj_t *read_exp(void *root) {
   for(;;) {
-    int c = getchar();
+    int c = next_char();
     if(c == ' ' || c == '\n' || c == '\r' || c == '\t') 
       continue;
     if(c == EOF)
@@ -385,6 +987,8 @@ static obj_t *read_exp(void *root) {
       return Dot;
     if(c == '\'')
       return read_quote(root);
+    if(c == '"')
+      return read_string(root);
     if(isdigit(c))
       return make_int(root, read_number(c - '0'));
     if(c == '-' && isdigit(peek()))
@@ -395,57 +999,387 @@ static obj_t *read_exp(void *root) {
   }
 }
 
-static void print(obj_t *obj) {
-  switch(obj->type) {
-    case TCELL:
-      printf("(");
-      for(;;) {
-        print(obj->car);
-        if(obj->cdr == Nil)
-          break;
-        if(obj->cdr->type != TCELL) {
-          printf(" . ");
-          print(obj->cdr);
-          break;
-        }
-        printf(" ");
-        return;
+static int length(obj_t *list) {
+  int len = 0;
+  for(; list->type == TCELL; list = list->cdr)
+    len++;
+  return list == Nil ? len : -1;
+}
+
+//---------------------------------------- 
+// PRINTER
+//---------------------------------------- 
+
+#define OUT_BUF_SIZE (1 << 16)
+
+typedef struct buffer_t {
+  char *data;
+  size_t len;
+  size_t cap;
+} buffer_t;
+
+static void buffer_reserve(buffer_t *b, size_t len) {
+  if(b->len + len <= b->cap)
+    return;
+  while(b->len + len > b->cap)
+    b->cap = b->cap ? b->cap * 2 : 4096;
+  b->data = realloc(b->data, b->cap);
+  if(!b->data)
+    error("allocation failed");
+}
+
+static void buffer_add(buffer_t *b, const char *data, size_t len) {
+  buffer_reserve(b, len);
+  memcpy(b->data + b->len, data, len);
+  b->len += len;
+}
+
+//everything written to stdout goes through out_buf
+static char out_buf[OUT_BUF_SIZE];
+static size_t out_len = 0;
+
+//collects the output instead of stdout if set
+static buffer_t *out_sink = 0;
+
+static void out_flush(void) {
+  if(out_sink) {
+    buffer_add(out_sink, out_buf, out_len);
+    out_len = 0;
+    return;
+  }
+  size_t done = 0;
+  while(done < out_len) {
+    ssize_t n = write(STDOUT_FILENO, out_buf + done, out_len - done);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n < 0)
+      break;
+    done += n;
+  }
+  out_len = 0;
+}
+
+static void out_write(const char *s, size_t len) {
+  if(out_len + len > OUT_BUF_SIZE)
+    out_flush();
+  if(len >= OUT_BUF_SIZE) {
+    while(len) {
+      size_t n = len < OUT_BUF_SIZE ? len : OUT_BUF_SIZE;
+      memcpy(out_buf, s, n);
+      out_len = n;
+      out_flush();
+      s += n;
+      len -= n;
+    }
+    return;
+  }
+  memcpy(out_buf + out_len, s, len);
+  out_len += len;
+}
+
+static void out_putc(char c) {
+  if(out_len == OUT_BUF_SIZE)
+    out_flush();
+  out_buf[out_len++] = c;
+}
+
+static void out_puts(const char *s) {
+  out_write(s, strlen(s));
+}
+
+static void out_int(long v) {
+  char buf[24];
+  int i = sizeof(buf);
+  unsigned long u = v < 0 ? -(unsigned long)v : v;
+  do {
+    buf[--i] = '0' + u % 10;
+    u /= 10;
+  } while(u);
+  if(v < 0)
+    buf[--i] = '-';
+  out_write(buf + i, sizeof(buf) - i);
+}
+
+static void out_string(obj_t *str) {
+  out_putc('"');
+  size_t start = 0;
+  for(size_t i = 0; i < str->len; i++) {
+    char c = str->chars[i];
+    if(c != '"' && c != '\\' && c != '\n' && c != '\t')
+      continue;
+    out_write(str->chars + start, i - start);
+    out_putc('\\');
+    out_putc(c == '\n' ? 'n' : c == '\t' ? 't' : c);
+    start = i + 1;
+  }
+  out_write(str->chars + start, str->len - start);
+  out_putc('"');
+}
+
+// Cells reachable more than once are printed as #n=... on their first
+// occurrence and #n# afterwards. Cycles are always labeled, shared
+// structure only with print_circle. Without it, objects are only scanned
+// for labels if print_cyclic finds a cycle.
+static int print_circle = 0;
+
+enum {
+  PRINT_NEW = 0,
+  PRINT_ACTIVE,     // on the current path, reaching it again is a cycle
+  PRINT_DONE,
+};
+
+typedef struct print_label_t {
+  obj_t *obj;
+  unsigned int epoch;   // entries of earlier prints are stale
+  unsigned char state;
+  int label;            // -1 if a label is needed, the label once printed
+} print_label_t;
+
+static print_label_t *labels = 0;
+static size_t labels_cap = 0;
+static size_t labels_used = 0;
+static unsigned int print_epoch = 0;
+
+typedef struct print_frame_t {
+  obj_t *obj;
+  int step;
+} print_frame_t;
+
+static print_frame_t *print_stack = 0;
+static size_t print_sp = 0;
+static size_t print_cap = 0;
+
+static void print_push(obj_t *obj, int step) {
+  if(print_sp == print_cap) {
+    print_cap = print_cap ? print_cap * 2 : 256;
+    print_stack = realloc(print_stack, sizeof(print_frame_t) * print_cap);
+    if(!print_stack)
+      error("allocation failed");
+  }
+  print_stack[print_sp++] = (print_frame_t) { obj, step };
+}
+
+static print_label_t *label_slot(print_label_t *table, size_t cap, obj_t *obj) {
+  size_t i = ((uintptr_t)obj >> 4) * 0x9e3779b97f4a7c15ull % cap;
+  while(table[i].epoch == print_epoch && table[i].obj != obj)
+    i = (i + 1) % cap;
+  return &table[i];
+}
+
+static print_label_t *label_find(obj_t *obj) {
+  print_label_t *l = label_slot(labels, labels_cap, obj);
+  return l->epoch == print_epoch ? l : 0;
+}
+
+static print_label_t *label_add(obj_t *obj) {
+  if((labels_used + 1) * 2 > labels_cap) {
+    size_t cap = labels_cap ? labels_cap * 2 : 1024;
+    print_label_t *table = calloc(cap, sizeof(print_label_t));
+    if(!table)
+      error("allocation failed");
+    for(size_t i = 0; i < labels_cap; i++)
+      if(labels[i].epoch == print_epoch)
+        *label_slot(table, cap, labels[i].obj) = labels[i];
+    free(labels);
+    labels = table;
+    labels_cap = cap;
+  }
+  print_label_t *l = label_slot(labels, labels_cap, obj);
+  *l = (print_label_t) { obj, print_epoch, PRINT_ACTIVE, 0 };
+  labels_used++;
+  return l;
+}
+
+//depth first walk over the cells of obj, returns the number of labels needed
+static int print_scan(obj_t *obj) {
+  int needed = 0;
+  if(++print_epoch == 0) {
+    for(size_t i = 0; i < labels_cap; i++)
+      labels[i].epoch = 0;
+    print_epoch = 1;
+  }
+  labels_used = 0;
+  label_add(obj);
+  print_sp = 0;
+  print_push(obj, 0);
+  while(print_sp) {
+    print_frame_t *f = &print_stack[print_sp - 1];
+    if(f->step == 2) {
+      label_find(f->obj)->state = PRINT_DONE;
+      print_sp--;
+      continue;
+    }
+    obj_t *next = f->step++ ? f->obj->cdr : f->obj->car;
+    if(next->type != TCELL)
+      continue;
+    print_label_t *l = label_find(next);
+    if(!l) {
+      label_add(next);
+      print_push(next, 0);
+    } else if(!l->label && (l->state == PRINT_ACTIVE || print_circle)) {
+      l->label = -1;
+      needed++;
+    }
+  }
+  return needed;
+}
+
+enum {
+  CYCLE_WALK,       // mark the cells of the list from obj on
+  CYCLE_CLEAR,      // unmark the list starting at obj
+};
+
+//walks every list with its cells marked while it is on the path, so a
+//marked cell reached again closes a cycle. the stack only grows with the
+//nesting of cars, not with the length of lists. once a cycle is found the
+//remaining frames only unmark
+static int print_cyclic(obj_t *obj) {
+  int found = 0;
+  print_sp = 0;
+  print_push(obj, CYCLE_CLEAR);
+  print_push(obj, CYCLE_WALK);
+  while(print_sp) {
+    print_frame_t f = print_stack[--print_sp];
+    obj_t *cell = f.obj;
+    if(f.step == CYCLE_CLEAR) {
+      for(; cell->type == TCELL && cell->on_path; cell = cell->cdr)
+        cell->on_path = 0;
+      continue;
+    }
+    for(; !found && cell->type == TCELL; cell = cell->cdr) {
+      if(cell->on_path) {
+        found = 1;
+        break;
       }
-      printf(")");
-      return;
+      cell->on_path = 1;
+      if(cell->car->type == TCELL) {
+        print_push(cell->cdr, CYCLE_WALK);
+        print_push(cell->car, CYCLE_CLEAR);
+        print_push(cell->car, CYCLE_WALK);
+        break;
+      }
+    }
+  }
+  return found;
+}
+
+enum {
+  PRINT_OBJ,        // print obj
+  PRINT_REST,       // car of obj is printed, continue with its cdr
+  PRINT_CLOSE,
+};
+
+//prints the cell obj or a reference to it, returns 1 if it has been printed before
+static int print_label(obj_t *obj, int *count) {
+  print_label_t *l = label_find(obj);
+  if(!l || !l->label)
+    return 0;
+  out_putc('#');
+  if(l->label > 0) {
+    out_int(l->label);
+    out_putc('#');
+    return 1;
+  }
+  l->label = ++*count;
+  out_int(l->label);
+  out_putc('=');
+  return 0;
+}
 
-#define CASE(type, ...)       \
-    case type:                  \
-                                printf(__VA_ARGS__);    \
-      return
-      CASE(TINT, "%d", obj->value);
-      CASE(TSYMBOL, "%s", obj->name);
+static void print(obj_t *obj) {
+  int labeled = obj->type == TCELL && (print_circle || print_cyclic(obj)) && print_scan(obj);
+  int count = 0;
+  print_sp = 0;
+  print_push(obj, PRINT_OBJ);
+  while(print_sp) {
+    print_frame_t f = print_stack[--print_sp];
+    obj = f.obj;
+    if(f.step == PRINT_CLOSE) {
+      out_putc(')');
+      continue;
+    }
+    if(f.step == PRINT_REST) {
+      obj_t *next = obj->cdr;
+      if(next == Nil) {
+        out_putc(')');
+      } else if(next->type != TCELL || (labeled && label_find(next)->label)) {
+        out_puts(" . ");
+        print_push(next, PRINT_CLOSE);
+        print_push(next, PRINT_OBJ);
+      } else {
+        out_putc(' ');
+        print_push(next, PRINT_REST);
+        print_push(next->car, PRINT_OBJ);
+      }
+      continue;
+    }
+    switch(obj->type) {
+      case TCELL:
+        if(labeled && print_label(obj, &count))
+          break;
+        out_putc('(');
+        print_push(obj, PRINT_REST);
+        print_push(obj->car, PRINT_OBJ);
+        break;
+      case TSTRING:
+        out_string(obj);
+        break;
+      case TINT:
+        out_int(obj->value);
+        break;
+      case TSYMBOL:
+        out_puts(obj->name);
+        break;
+#define CASE(type, str)       \
+      case type:              \
+        out_puts(str);        \
+        break
       CASE(TPRIMITIVE, "<primitive>");
       CASE(TFUNCTION, "<function>");
       CASE(TMACRO, "<macro>");
+      CASE(TSTREAM, "<stream>");
       CASE(TTRUE, "t");
       CASE(TNIL, "()");
 #undef CASE
-
-    default:
-      error("compiler error: unknown tag type");
+      default:
+        error("compiler error: unknown tag type");
+    }
   }
 }
 
-static int length(obj_t *list) {
-  int len = 0;
-  for(; list->type == TCELL; list = list->cdr)
-    len++;
-  return list == Nil ? len : -1;
-}
-
 //---------------------------------------- 
 // EVALUATOR
 //---------------------------------------- 
 
 static obj_t *eval(void *root, obj_t **env, obj_t **obj);
+static obj_t *find(obj_t **env, obj_t *sym);
+
+//bumped whenever a global binding may have changed, see find_head
+static unsigned long global_version = 0;
+
+//bumped when a global binding of a primitive, macro or t changes. function
+//bodies rewritten by the optimizer depend on those, see prim_guarded
+static unsigned long opt_version = 0;
+
+static void rebind_global(obj_t *old) {
+  if(old->type == TPRIMITIVE || old->type == TMACRO || old == True)
+    opt_version++;
+}
+
+//global lookups are only cached for symbols that are never bound locally
+static void bind_local(obj_t *sym) {
+  if(!sym->local) {
+    sym->local = 1;
+    global_version++;
+  }
+}
 
 static void add_variable(void *root, obj_t **env, obj_t **sym, obj_t **val) {
+  if((*env)->up != Nil)
+    bind_local(*sym);
+  else if(find(env, *sym))
+    rebind_global(find(env, *sym)->cdr);
+  global_version++;
   DEFINE2(vars, tmp);
   *vars = (*env)->vars;
   *tmp = acons(root, sym, val, vars);
@@ -460,16 +1394,20 @@ static obj_t *push_env(void *root, obj_t **env, obj_t **vars, obj_t **vals) {
       error("cannot apply function: number of argument does not match");
     *sym = (*vars)->car;
     *val = (*vals)->car;
+    bind_local(*sym);
     *map = acons(root, sym, val, map);
   }
-  if(*vars != Nil)
+  if(*vars != Nil) {
+    bind_local(*vars);
     *map = acons(root, vars, vals, map);
+  }
   return make_env(root, map, env);
 }
 
 //evaluates the list elements from the head and returns the last value
 static obj_t *progn(void *root, obj_t **env, obj_t **list) {
   DEFINE2(lp, r);
+  *r = Nil;
   for(*lp = *list; *lp != Nil; *lp = (*lp)->cdr) {
     *r = (*lp)->car;
     *r = eval(root, env, r);
@@ -493,7 +1431,11 @@ static int is_list(obj_t *obj) {
   return obj == Nil || obj->type == TCELL;
 }
 
-static obj_t *apply_func(void *root, obj_t **env, obj_t **fn, obj_t **args) {
+static int jit_enabled = 0;
+static int jit_suspended = 0;  // nesting of --jit-verify reference runs
+static obj_t *jit_call(void *root, obj_t **fn, obj_t **args);
+
+static obj_t *interpret_func(void *root, obj_t **fn, obj_t **args) {
   DEFINE3(params, newenv, body);
   *params = (*fn)->params;
   *newenv = (*fn)->env;
@@ -502,6 +1444,15 @@ static obj_t *apply_func(void *root, obj_t **env, obj_t **fn, obj_t **args) {
   return progn(root, newenv, body);
 }
 
+static obj_t *apply_func(void *root, obj_t **env, obj_t **fn, obj_t **args) {
+  if(jit_enabled && !jit_suspended && (*fn)->type == TFUNCTION) {
+    obj_t *ret = jit_call(root, fn, args);
+    if(ret)
+      return ret;
+  }
+  return interpret_func(root, fn, args);
+}
+
 //apply fn with args
 static obj_t *apply(void *root, obj_t **env, obj_t **fn, obj_t **args) {
   if(!is_list(*args))
@@ -516,21 +1467,53 @@ static obj_t *apply(void *root, obj_t **env, obj_t **fn, obj_t **args) {
   error("not supported");
 }
 
-//searches for a variable by symbol. returns 0 if not found
-static obj_t *find(obj_t **env, obj_t *sym) {
+//searches for a variable by symbol and the frame holding it. returns 0 if not found
+static obj_t *find_frame(obj_t **env, obj_t *sym, obj_t **frame) {
   for(obj_t *p = *env; p != Nil; p = p->up) {
     for(obj_t *cell = p->vars; cell != Nil; cell = cell->cdr) {
       obj_t *bind = cell->car;
-      if(sym == bind->car)
+      if(sym == bind->car) {
+        *frame = p;
         return bind;
+      }
     }
   }
   return 0;
 }
 
-//expands the given macro application form
-static obj_t *macroexpand(void *root, obj_t **env, obj_t **obj) {
-  if((*obj)->type != TCELL || (*obj)->car->type != TSYMBOL)
+//searches for a variable by symbol. returns 0 if not found
+static obj_t *find(obj_t **env, obj_t *sym) {
+  obj_t *frame;
+  return find_frame(env, sym, &frame);
+}
+
+#define CALL_CACHE_SIZE 4096
+
+//global binding of the head symbol of a call site
+typedef struct call_cache_t {
+  obj_t *site;
+  obj_t *sym;
+  obj_t *bind;
+  unsigned long version;
+} call_cache_t;
+
+static call_cache_t call_cache[CALL_CACHE_SIZE];
+
+//searches the binding of the head symbol of the call site obj
+static obj_t *find_head(obj_t **env, obj_t *obj) {
+  call_cache_t *cache = &call_cache[((uintptr_t)obj >> 4) % CALL_CACHE_SIZE];
+  if(cache->site == obj && cache->sym == obj->car && cache->version == global_version)
+    return cache->bind;
+  obj_t *bind = find(env, obj->car);
+  //a symbol never bound locally can only be bound in the global frame
+  if(bind && !obj->car->local)
+    *cache = (call_cache_t) { obj, obj->car, bind, global_version };
+  return bind;
+}
+
+//expands the given macro application form
+static obj_t *macroexpand(void *root, obj_t **env, obj_t **obj) {
+  if((*obj)->type != TCELL || (*obj)->car->type != TSYMBOL)
     return *obj;
   DEFINE3(bind, macro, args);
   *bind = find(env, (*obj)->car);
@@ -542,9 +1525,18 @@ static obj_t *macroexpand(void *root, obj_t **env, obj_t **obj) {
 }
 
 //evaluates the s expression
+//nested evaluation of lists is limited so deep recursion fails with an
+//error instead of overflowing the C stack. main sets the limit from the
+//stack size, a level takes less than EVAL_FRAME_SIZE bytes of it
+#define EVAL_FRAME_SIZE 1024
+static long eval_max_depth = 8 * 1024 * 1024 / EVAL_FRAME_SIZE;
+static long eval_depth = 0;
+
 static obj_t *eval(void *root, obj_t **env, obj_t **obj) {
   switch((*obj)->type) {
     case TINT:
+    case TSTRING:
+    case TSTREAM:
     case TPRIMITIVE:
     case TFUNCTION:
     case TTRUE:
@@ -558,16 +1550,30 @@ static obj_t *eval(void *root, obj_t **env, obj_t **obj) {
                     return bind->cdr;
                   }
     case TCELL: {
+                  if(++eval_depth > eval_max_depth)
+                    error("recursion too deep");
                   DEFINE3(fn, expanded, args);
-                  *expanded = macroexpand(root, env, obj);
-                  if(*expanded != *obj)
-                    return eval(root, env, expanded);
-                  *fn = (*obj)->car;
-                  *fn = eval(root, env, fn);
                   *args = (*obj)->cdr;
+                  if((*obj)->car->type == TSYMBOL) {
+                    obj_t *bind = find_head(env, *obj);
+                    if(!bind)
+                      error("undefined symbol: %s", (*obj)->car->name);
+                    *fn = bind->cdr;
+                    if((*fn)->type == TMACRO) {
+                      *expanded = apply_func(root, env, fn, args);
+                      *expanded = eval(root, env, expanded);
+                      eval_depth--;
+                      return *expanded;
+                    }
+                  } else {
+                    *fn = (*obj)->car;
+                    *fn = eval(root, env, fn);
+                  }
                   if((*fn)->type != TPRIMITIVE && (*fn)->type != TFUNCTION)
                     error("the head of a list must be a function");
-                  return apply(root, env, fn, args);
+                  *expanded = apply(root, env, fn, args);
+                  eval_depth--;
+                  return *expanded;
                 }
     default:
                 error("bug: eval: unknown tag type: %d", (*obj)->type);
@@ -614,12 +1620,16 @@ static obj_t *prim_cdr(void *root, obj_t **env, obj_t **list) {
 static obj_t *prim_setq(void *root, obj_t **env, obj_t **list) {
   if(length(*list) != 2 || (*list)->car->type != TSYMBOL)
     error("malformed setq");
-  DEFINE2(bind, value);
-  *bind = find(env, (*list)->car);
+  DEFINE3(bind, frame, value);
+  *bind = find_frame(env, (*list)->car, frame);
   if(!*bind) 
     error("unbound variable %s", (*list)->car->name);
   *value = (*list)->cdr->car;
   *value = eval(root, env, value);
+  if((*frame)->up == Nil) {
+    rebind_global((*bind)->cdr);
+    global_version++;
+  }
   (*bind)->cdr = *value;
   return *value;
 }
@@ -640,13 +1650,135 @@ static obj_t *prim_while(void *root, obj_t **env, obj_t **list) {
     error("malformed while");
   DEFINE2(cond, exprs);
   *cond = (*list)->car;
-  while(eval(root, env, cond) != Nil) {
-    *exprs = (*list)->cdr;
-    eval_list(root, env, exprs);
-  }
+  *exprs = (*list)->cdr;
+  while(eval(root, env, cond) != Nil)
+    progn(root, env, exprs);
   return Nil;
 }
 
+//new frame on top of env binding sym to val, its binding is stored in bind
+static obj_t *loop_env(void *root, obj_t **env, obj_t **sym, obj_t **val, obj_t **bind) {
+  DEFINE1(map);
+  *map = Nil;
+  *map = acons(root, sym, val, map);
+  *bind = (*map)->car;
+  bind_local(*sym);
+  return make_env(root, map, env);
+}
+
+static obj_t *prim_add(void *root, obj_t **env, obj_t **list);
+static obj_t *prim_sub(void *root, obj_t **env, obj_t **list);
+static obj_t *prim_mult(void *root, obj_t **env, obj_t **list);
+static obj_t *prim_lt(void *root, obj_t **env, obj_t **list);
+static obj_t *prim_eq(void *root, obj_t **env, obj_t **list);
+static obj_t *prim_cmp(void *root, obj_t **env, obj_t **list);
+static obj_t *prim_print(void *root, obj_t **env, obj_t **list);
+
+//checks that sym is only passed to primitives that read integers without
+//keeping them, so the value bound to it can not escape form
+static int int_private(obj_t **env, obj_t *form, obj_t *sym) {
+  if(form == sym)
+    return 0;
+  if(form->type != TCELL)
+    return 1;
+  obj_t *bind = form->car->type == TSYMBOL ? find(env, form->car) : 0;
+  obj_t *head = bind ? bind->cdr : 0;
+  if(head && head->type == TMACRO)
+    return 0;
+  if(head && head->type == TPRIMITIVE) {
+    primitive *fn = head->fn;
+    if(fn == prim_quote)
+      return 1;
+    if(fn == prim_add || fn == prim_sub || fn == prim_mult || fn == prim_lt
+        || fn == prim_eq || fn == prim_cmp || fn == prim_print) {
+      obj_t *p = form->cdr;
+      for(; p->type == TCELL; p = p->cdr)
+        if(p->car != sym && !int_private(env, p->car, sym))
+          return 0;
+      return p != sym;
+    }
+  }
+  for(; form->type == TCELL; form = form->cdr)
+    if(!int_private(env, form->car, sym))
+      return 0;
+  return form != sym;
+}
+
+static int body_private(obj_t **env, obj_t *body, obj_t *sym) {
+  for(; body->type == TCELL; body = body->cdr)
+    if(!int_private(env, body->car, sym))
+      return 0;
+  return 1;
+}
+
+// (dotimes (<symbol> count result) expr ...)
+static obj_t *prim_dotimes(void *root, obj_t **env, obj_t **list) {
+  if(length(*list) < 1 || (*list)->car->type != TCELL || (*list)->car->car->type != TSYMBOL
+      || length((*list)->car) < 2 || length((*list)->car) > 3)
+    error("malformed dotimes");
+  DEFINE5(sym, val, frame, bind, body);
+  *sym = (*list)->car->car;
+  *val = (*list)->car->cdr->car;
+  *val = eval(root, env, val);
+  if((*val)->type != TINT)
+    error("dotimes takes a number");
+  int count = (*val)->value < 0 ? 0 : (*val)->value;
+  *val = make_int(root, 0);
+  *frame = loop_env(root, env, sym, val, bind);
+  *body = (*list)->cdr;
+
+  //the counter is updated in place while the body can not keep it, checked
+  //again whenever a global binding changed and given up for good once it could
+  unsigned long version = global_version;
+  int in_place = body_private(frame, *body, *sym);
+  for(int i = 0; i < count; i++) {
+    if(i) {
+      if(in_place && version != global_version) {
+        version = global_version;
+        in_place = body_private(frame, *body, *sym);
+      }
+      if(in_place)
+        (*bind)->cdr->value = i;
+      else
+        (*bind)->cdr = make_int(root, i);
+    }
+    progn(root, frame, body);
+  }
+
+  *body = (*list)->car->cdr->cdr;
+  if(*body == Nil)
+    return Nil;
+  (*bind)->cdr = make_int(root, count);
+  *body = (*body)->car;
+  return eval(root, frame, body);
+}
+
+// (dolist (<symbol> list result) expr ...)
+static obj_t *prim_dolist(void *root, obj_t **env, obj_t **list) {
+  if(length(*list) < 1 || (*list)->car->type != TCELL || (*list)->car->car->type != TSYMBOL
+      || length((*list)->car) < 2 || length((*list)->car) > 3)
+    error("malformed dolist");
+  DEFINE5(sym, lp, frame, bind, body);
+  *sym = (*list)->car->car;
+  *lp = (*list)->car->cdr->car;
+  *lp = eval(root, env, lp);
+  if(!is_list(*lp))
+    error("dolist takes a list");
+  *frame = loop_env(root, env, sym, &Nil, bind);
+  *body = (*list)->cdr;
+  for(; (*lp)->type == TCELL; *lp = (*lp)->cdr) {
+    (*bind)->cdr = (*lp)->car;
+    progn(root, frame, body);
+  }
+
+  *body = (*list)->car->cdr->cdr;
+  if(*body == Nil)
+    return Nil;
+  (*bind)->cdr = Nil;
+  *body = (*body)->car;
+  return eval(root, frame, body);
+}
+
 // (gensym)
 static obj_t *prim_gensym(void *root, obj_t **env, obj_t **list) {
   static int count = 0;
@@ -741,7 +1873,7 @@ static obj_t *prim_defun(void *root, obj_t **env, obj_t **list) {
 
 // (define <symbol> expr) 
 static obj_t *prim_define(void *root, obj_t **env, obj_t **list) {
-  if(length(*list) != 2 || (*list)->car->type == TSYMBOL) 
+  if(length(*list) != 2 || (*list)->car->type != TSYMBOL) 
     error("malformed define");
   DEFINE2(sym, value);
   *sym = (*list)->car;
@@ -770,7 +1902,7 @@ static obj_t *prim_print(void *root, obj_t **env, obj_t **list) {
   DEFINE1(tmp);
   *tmp = (*list)->car;
   print(eval(root, env, tmp));
-  printf("\n");
+  out_putc('\n');
   return Nil;
 }
 
@@ -786,7 +1918,74 @@ static obj_t *prim_if(void *root, obj_t **env, obj_t **list) {
     return eval(root, env, then);
   }
   *els = (*list)->cdr->cdr;
-  return *els = Nil ? Nil : progn(root, env, els);
+  return *els == Nil ? Nil : progn(root, env, els);
+}
+
+// (let ((<symbol> expr) ...) expr ...)
+static obj_t *prim_let(void *root, obj_t **env, obj_t **list) {
+  if(length(*list) < 1 || !is_list((*list)->car))
+    error("malformed let");
+  DEFINE4(lp, map, sym, val);
+  *map = Nil;
+  for(*lp = (*list)->car; *lp != Nil; *lp = (*lp)->cdr) {
+    if((*lp)->car->type == TSYMBOL) {
+      *sym = (*lp)->car;
+      *val = Nil;
+    } else if((*lp)->car->type == TCELL && (*lp)->car->car->type == TSYMBOL
+        && length((*lp)->car) == 2) {
+      *sym = (*lp)->car->car;
+      *val = (*lp)->car->cdr->car;
+      *val = eval(root, env, val);
+    } else {
+      error("malformed let");
+    }
+    bind_local(*sym);
+    *map = acons(root, sym, val, map);
+  }
+  *map = make_env(root, map, env);
+  *lp = (*list)->cdr;
+  return progn(root, map, lp);
+}
+
+// (cond (test expr ...) ...)
+static obj_t *prim_cond(void *root, obj_t **env, obj_t **list) {
+  DEFINE2(lp, value);
+  for(*lp = *list; *lp != Nil; *lp = (*lp)->cdr) {
+    if((*lp)->type != TCELL || (*lp)->car->type != TCELL)
+      error("malformed cond");
+    *value = (*lp)->car->car;
+    *value = eval(root, env, value);
+    if(*value != Nil) {
+      *lp = (*lp)->car->cdr;
+      return *lp == Nil ? *value : progn(root, env, lp);
+    }
+  }
+  return Nil;
+}
+
+// (and expr ...)
+static obj_t *prim_and(void *root, obj_t **env, obj_t **list) {
+  DEFINE2(lp, value);
+  *value = True;
+  for(*lp = *list; *lp != Nil; *lp = (*lp)->cdr) {
+    *value = (*lp)->car;
+    *value = eval(root, env, value);
+    if(*value == Nil)
+      return Nil;
+  }
+  return *value;
+}
+
+// (or expr ...)
+static obj_t *prim_or(void *root, obj_t **env, obj_t **list) {
+  DEFINE2(lp, value);
+  for(*lp = *list; *lp != Nil; *lp = (*lp)->cdr) {
+    *value = (*lp)->car;
+    *value = eval(root, env, value);
+    if(*value != Nil)
+      return *value;
+  }
+  return Nil;
 }
 
 // (eq <integer> <integer>)
@@ -809,12 +2008,1301 @@ static obj_t *prim_cmp(void *root, obj_t **env, obj_t **list) {
   return values->car == values->cdr->car ? True : Nil;
 }
 
+static obj_t *string_arg(obj_t *args, int i, char *name) {
+  for(; i > 0 && args != Nil; i--)
+    args = args->cdr;
+  if(args == Nil || args->car->type != TSTRING)
+    error("%s takes a string", name);
+  return args->car;
+}
+
+//nul terminated copy of str, has to be freed
+static char *string_cstr(obj_t *str) {
+  char *s = malloc(str->len + 1);
+  if(!s)
+    error("allocation failed");
+  memcpy(s, str->chars, str->len);
+  s[str->len] = 0;
+  return s;
+}
+
+//files like those in /proc report a size of 0, they are read into an
+//anonymous mapping instead of being mapped
+static char *read_unsized(int fd, size_t *len) {
+  size_t cap = 4096;
+  char *buf = malloc(cap);
+  *len = 0;
+  while(buf) {
+    ssize_t n = read(fd, buf + *len, cap - *len);
+    if(n < 0) {
+      free(buf);
+      return 0;
+    }
+    if(!n)
+      break;
+    *len += n;
+    if(*len == cap) {
+      char *grown = realloc(buf, cap *= 2);
+      if(!grown)
+        free(buf);
+      buf = grown;
+    }
+  }
+  if(!buf)
+    return 0;
+  char *chars = "";
+  if(*len) {
+    chars = mmap(0, *len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(chars == MAP_FAILED)
+      chars = 0;
+    else
+      memcpy(chars, buf, *len);
+  }
+  free(buf);
+  return chars;
+}
+
+// (read-file <string>)
+static obj_t *prim_read_file(void *root, obj_t **env, obj_t **list) {
+  if(length(*list) != 1)
+    error("malformed read-file");
+  DEFINE2(name, str);
+  *name = eval_list(root, env, list);
+  *name = string_arg(*name, 0, "read-file");
+  //allocated up front, nothing may fail while the file is open
+  *str = make_mapped_string(root, "", 0);
+  char *path = string_cstr(*name);
+  int fd = open(path, O_RDONLY);
+  free(path);
+  if(fd < 0)
+    error("unable to open %.*s", (int)(*name)->len, (*name)->chars);
+  struct stat st;
+  char *fail = 0;
+  char *chars = "";
+  size_t len = 0;
+  if(fstat(fd, &st)) {
+    fail = "unable to stat";
+  } else if(!S_ISREG(st.st_mode)) {
+    fail = "not a regular file:";
+  } else if(st.st_size) {
+    len = st.st_size;
+    chars = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(chars == MAP_FAILED)
+      fail = "unable to map";
+  } else if(!(chars = read_unsized(fd, &len))) {
+    fail = "unable to read";
+  }
+  close(fd);
+  if(fail)
+    error("%s %.*s", fail, (int)(*name)->len, (*name)->chars);
+  (*str)->chars = chars;
+  (*str)->len = len;
+  (*str)->mapped = len > 0;
+  return *str;
+}
+
+// (write-file <string> <string>)
+static obj_t *prim_write_file(void *root, obj_t **env, obj_t **list) {
+  if(length(*list) != 2)
+    error("malformed write-file");
+  obj_t *args = eval_list(root, env, list);
+  obj_t *str = string_arg(args, 1, "write-file");
+  obj_t *name = string_arg(args, 0, "write-file");
+  char *path = string_cstr(name);
+  FILE *file = fopen(path, "wb");
+  free(path);
+  int failed = !file;
+  if(file) {
+    failed = fwrite(str->chars, 1, str->len, file) != str->len;
+    failed |= fclose(file) != 0;
+  }
+  if(failed)
+    error("unable to write %.*s", (int)name->len, name->chars);
+  return True;
+}
+
+// (substring <string> <integer> <integer>)
+static obj_t *prim_substring(void *root, obj_t **env, obj_t **list) {
+  if(length(*list) != 3)
+    error("malformed substring");
+  DEFINE2(args, str);
+  *args = eval_list(root, env, list);
+  *str = string_arg(*args, 0, "substring");
+  obj_t *start = (*args)->cdr->car;
+  obj_t *end = (*args)->cdr->cdr->car;
+  if(start->type != TINT || end->type != TINT)
+    error("substring takes only numbers as bounds");
+  if(start->value < 0 || start->value > end->value || end->value > (*str)->len)
+    error("substring out of range");
+  return make_slice(root, str, start->value, end->value - start->value);
+}
+
+// (string-length <string>)
+static obj_t *prim_string_length(void *root, obj_t **env, obj_t **list) {
+  if(length(*list) != 1)
+    error("malformed string-length");
+  obj_t *args = eval_list(root, env, list);
+  return make_int(root, string_arg(args, 0, "string-length")->len);
+}
+
+// (string-split <string> <string>)
+static obj_t *prim_string_split(void *root, obj_t **env, obj_t **list) {
+  if(length(*list) != 2)
+    error("malformed string-split");
+  DEFINE4(args, str, head, part);
+  *args = eval_list(root, env, list);
+  *str = string_arg(*args, 0, "string-split");
+  obj_t *sep = string_arg(*args, 1, "string-split");
+  if(!sep->len)
+    error("string-split takes a non empty separator");
+  *head = Nil;
+  size_t start = 0;
+  for(size_t pos = 0; pos + sep->len <= (*str)->len;) {
+    char *next = memchr((*str)->chars + pos, sep->chars[0], (*str)->len - pos);
+    if(!next)
+      break;
+    pos = next - (*str)->chars;
+    if(pos + sep->len > (*str)->len)
+      break;
+    if(memcmp(next, sep->chars, sep->len)) {
+      pos++;
+      continue;
+    }
+    *part = make_slice(root, str, start, pos - start);
+    *head = cons(root, part, head);
+    pos += sep->len;
+    start = pos;
+  }
+  *part = make_slice(root, str, start, (*str)->len - start);
+  *head = cons(root, part, head);
+  return reverse(*head);
+}
+
+// (string-concat <string or list of strings> ...)
+static obj_t *prim_string_concat(void *root, obj_t **env, obj_t **list) {
+  DEFINE2(args, str);
+  *args = eval_list(root, env, list);
+  //sum up the length first so the result is copied exactly once
+  size_t len = 0;
+  for(obj_t *p = *args; p != Nil; p = p->cdr) {
+    obj_t *part = p->car;
+    if(part->type == TSTRING) {
+      len += part->len;
+      continue;
+    }
+    for(; part->type == TCELL && part->car->type == TSTRING; part = part->cdr)
+      len += part->car->len;
+    if(part != Nil)
+      error("string-concat takes only strings and lists of strings");
+  }
+  *str = make_string(root, len);
+  char *out = (*str)->chars;
+  for(obj_t *p = *args; p != Nil; p = p->cdr) {
+    if(p->car->type == TSTRING) {
+      memcpy(out, p->car->chars, p->car->len);
+      out += p->car->len;
+      continue;
+    }
+    for(obj_t *part = p->car; part != Nil; part = part->cdr) {
+      memcpy(out, part->car->chars, part->car->len);
+      out += part->car->len;
+    }
+  }
+  return *str;
+}
+
 // (quit)
 static obj_t *prim_quit(void *root, obj_t **env, obj_t **list) {
-  printf("bye!\n");
+  out_puts("bye!\n");
+  //a client of the server only ends its own connection
+  if(error_handler)
+    longjmp(*error_handler, QUIT_REQUEST);
   exit(0);
 }
 
+//---------------------------------------- 
+// STREAMS
+//---------------------------------------- 
+
+// A stream yields its elements one at a time when they are pulled, so
+// map/filter/take stages chained on top of each other pass each element
+// straight through without building lists. Sources are lists, integer
+// ranges, the lines of a string (a mapped file with read-file) and
+// iterated functions. Streams keep their position and can only be
+// consumed once.
+
+//argument list fn can be called with repeatedly, () if fn may keep its
+//arguments (a rest parameter)
+static obj_t *stream_args(void *root, obj_t **fn, int n) {
+  DEFINE1(args);
+  *args = Nil;
+  if(length((*fn)->params) < 0)
+    return *args;
+  while(n--)
+    *args = cons(root, &Nil, args);
+  return *args;
+}
+
+//applying consumes the argument list reference, args stays untouched
+static obj_t *stream_apply(void *root, obj_t **env, obj_t **fn, obj_t *args) {
+  DEFINE1(call);
+  *call = args;
+  return apply_func(root, env, fn, call);
+}
+
+static obj_t *stream_call(void *root, obj_t **env, obj_t **stream, obj_t **value) {
+  DEFINE2(fn, args);
+  *fn = (*stream)->proc;
+  *args = (*stream)->args;
+  if(*args != Nil) {
+    (*args)->car = *value;
+  } else {
+    *args = cons(root, value, args);
+  }
+  return apply_func(root, env, fn, args);
+}
+
+//next element of stream, 0 once it is exhausted
+static obj_t *stream_next(void *root, obj_t **env, obj_t **stream) {
+  DEFINE2(src, value);
+  *src = (*stream)->src;
+  switch((*stream)->kind) {
+    case STREAM_LIST:
+      if((*src)->type != TCELL)
+        return 0;
+      (*stream)->src = (*src)->cdr;
+      return (*src)->car;
+    case STREAM_RANGE:
+      if((*stream)->step > 0 ? (*stream)->pos >= (*stream)->end : (*stream)->pos <= (*stream)->end)
+        return 0;
+      *value = make_int(root, (*stream)->pos);
+      (*stream)->pos += (*stream)->step;
+      return *value;
+    case STREAM_LINES: {
+      size_t start = (*stream)->pos;
+      if(start >= (*src)->len)
+        return 0;
+      char *nl = memchr((*src)->chars + start, '\n', (*src)->len - start);
+      size_t end = nl ? (size_t)(nl - (*src)->chars) : (*src)->len;
+      (*stream)->pos = end + 1;
+      return make_slice(root, src, start, end - start);
+    }
+    case STREAM_ITERATE:
+      //the first pull yields the initial value
+      if((*stream)->pos++)
+        (*stream)->src = stream_call(root, env, stream, src);
+      return (*stream)->src;
+    case STREAM_MAP:
+      *value = stream_next(root, env, src);
+      if(!*value)
+        return 0;
+      return stream_call(root, env, stream, value);
+    case STREAM_FILTER:
+      for(;;) {
+        *value = stream_next(root, env, src);
+        if(!*value)
+          return 0;
+        if(stream_call(root, env, stream, value) != Nil)
+          return *value;
+      }
+    case STREAM_TAKE:
+      if((*stream)->pos <= 0)
+        return 0;
+      (*stream)->pos--;
+      return stream_next(root, env, src);
+  }
+  error("bug: unknown stream kind %d", (*stream)->kind);
+  return 0;
+}
+
+static obj_t *stream_source(void *root, int kind, obj_t **src, long pos, long end, long step) {
+  obj_t *obj = make_stream(root, kind, src, &Nil, &Nil);
+  obj->pos = pos;
+  obj->end = end;
+  obj->step = step;
+  return obj;
+}
+
+//evaluates (fn <stream>) style arguments of a stage
+static obj_t *stream_stage_args(void *root, obj_t **env, obj_t **list, char *name) {
+  obj_t *args = eval_list(root, env, list);
+  if(length(args) != 2 || args->car->type != TFUNCTION || args->cdr->car->type != TSTREAM)
+    error("%s takes a function and a stream", name);
+  return args;
+}
+
+static obj_t *stream_stage(void *root, obj_t **env, obj_t **list, int kind, char *name) {
+  DEFINE3(args, fn, src);
+  *args = stream_stage_args(root, env, list, name);
+  *fn = (*args)->car;
+  *src = (*args)->cdr->car;
+  *args = stream_args(root, fn, 1);
+  return make_stream(root, kind, src, fn, args);
+}
+
+// (stream <list>)
+static obj_t *prim_stream(void *root, obj_t **env, obj_t **list) {
+  DEFINE1(args);
+  *args = eval_list(root, env, list);
+  if(length(*args) != 1 || !is_list((*args)->car))
+    error("stream takes a list");
+  *args = (*args)->car;
+  return stream_source(root, STREAM_LIST, args, 0, 0, 0);
+}
+
+// (stream-range <integer> <integer> <integer>)
+static obj_t *prim_stream_range(void *root, obj_t **env, obj_t **list) {
+  obj_t *args = eval_list(root, env, list);
+  int n = length(args);
+  if(n < 2 || n > 3)
+    error("malformed stream-range");
+  for(obj_t *p = args; p != Nil; p = p->cdr)
+    if(p->car->type != TINT)
+      error("stream-range takes only numbers");
+  long step = n == 3 ? args->cdr->cdr->car->value : 1;
+  if(!step)
+    error("stream-range step must not be 0");
+  return stream_source(root, STREAM_RANGE, &Nil, args->car->value, args->cdr->car->value, step);
+}
+
+// (stream-lines <string>)
+static obj_t *prim_stream_lines(void *root, obj_t **env, obj_t **list) {
+  DEFINE1(args);
+  *args = eval_list(root, env, list);
+  if(length(*args) != 1)
+    error("malformed stream-lines");
+  *args = string_arg(*args, 0, "stream-lines");
+  return stream_source(root, STREAM_LINES, args, 0, 0, 0);
+}
+
+// (stream-iterate fn init)
+static obj_t *prim_stream_iterate(void *root, obj_t **env, obj_t **list) {
+  DEFINE3(args, fn, init);
+  *args = eval_list(root, env, list);
+  if(length(*args) != 2 || (*args)->car->type != TFUNCTION)
+    error("stream-iterate takes a function and a value");
+  *fn = (*args)->car;
+  *init = (*args)->cdr->car;
+  *args = stream_args(root, fn, 1);
+  return make_stream(root, STREAM_ITERATE, init, fn, args);
+}
+
+// (stream-map fn <stream>)
+static obj_t *prim_stream_map(void *root, obj_t **env, obj_t **list) {
+  return stream_stage(root, env, list, STREAM_MAP, "stream-map");
+}
+
+// (stream-filter fn <stream>)
+static obj_t *prim_stream_filter(void *root, obj_t **env, obj_t **list) {
+  return stream_stage(root, env, list, STREAM_FILTER, "stream-filter");
+}
+
+// (stream-take <integer> <stream>)
+static obj_t *prim_stream_take(void *root, obj_t **env, obj_t **list) {
+  DEFINE1(args);
+  *args = eval_list(root, env, list);
+  if(length(*args) != 2 || (*args)->car->type != TINT || (*args)->cdr->car->type != TSTREAM)
+    error("stream-take takes a number and a stream");
+  long n = (*args)->car->value;
+  *args = (*args)->cdr->car;
+  obj_t *obj = make_stream(root, STREAM_TAKE, args, &Nil, &Nil);
+  obj->pos = n;
+  return obj;
+}
+
+// (stream-reduce fn init <stream>)
+static obj_t *prim_stream_reduce(void *root, obj_t **env, obj_t **list) {
+  DEFINE5(args, fn, acc, stream, value);
+  *args = eval_list(root, env, list);
+  if(length(*args) != 3 || (*args)->car->type != TFUNCTION
+      || (*args)->cdr->cdr->car->type != TSTREAM)
+    error("stream-reduce takes a function, a value and a stream");
+  *fn = (*args)->car;
+  *acc = (*args)->cdr->car;
+  *stream = (*args)->cdr->cdr->car;
+  *args = stream_args(root, fn, 2);
+  int reuse = *args != Nil;
+  while((*value = stream_next(root, env, stream))) {
+    if(reuse) {
+      (*args)->car = *acc;
+      (*args)->cdr->car = *value;
+    } else {
+      *args = Nil;
+      *args = cons(root, value, args);
+      *args = cons(root, acc, args);
+    }
+    *acc = stream_apply(root, env, fn, *args);
+  }
+  return *acc;
+}
+
+//---------------------------------------- 
+// OPTIMIZER
+//---------------------------------------- 
+
+// Top level forms are rewritten once before they are evaluated: macros
+// are expanded, add/sub/mult/lt/eq over integers are folded, if with a
+// constant condition is replaced by the branch taken, quote around
+// self-evaluating objects is dropped and calls of small global
+// functions are replaced by their body. Rewrites are based on the global
+// bindings at that time. Names assigned anywhere in the form count as
+// bound, so they are never rewritten.
+//
+// Calls are only inlined in code that runs right away, not in lambda
+// bodies. The inlined body is wrapped in a guard that falls back to the
+// original call once global_version moved past the one it was built at.
+// Rewritten lambda bodies keep the original body too, which runs once a
+// global primitive, macro or t was rebound, see opt_version.
+
+#define OPT_INLINE_MAX 16
+#define OPT_INLINE_DEPTH 4
+
+static int opt_enabled = 1;
+static unsigned long opt_folds = 0;
+static unsigned long opt_branches = 0;
+static unsigned long opt_quotes = 0;
+static unsigned long opt_inlines = 0;
+static int opt_depth = 0;
+static int opt_function = 0;  // nesting of lambda bodies
+static obj_t **opt_stamp;     // global_version the current form is optimized at
+
+//parameters of the enclosing lambdas
+typedef struct opt_scope_t {
+  obj_t *params;
+  struct opt_scope_t *up;
+} opt_scope_t;
+
+static int opt_bound(opt_scope_t *scope, obj_t *sym) {
+  for(; scope; scope = scope->up) {
+    obj_t *p = scope->params;
+    for(; p->type == TCELL; p = p->cdr)
+      if(p->car == sym)
+        return 1;
+    if(p == sym)
+      return 1;
+  }
+  return 0;
+}
+
+static int is_constant(obj_t *obj) {
+  return obj->type == TINT || obj->type == TSTRING || obj == True || obj == Nil;
+}
+
+//global value of sym if it is not shadowed in scope
+static obj_t *opt_global(obj_t **env, opt_scope_t *scope, obj_t *sym) {
+  if(sym->type != TSYMBOL || opt_bound(scope, sym))
+    return 0;
+  obj_t *bind = find(env, sym);
+  return bind ? bind->cdr : 0;
+}
+
+static int is_prim(obj_t *obj, primitive *fn) {
+  return obj && obj->type == TPRIMITIVE && obj->fn == fn;
+}
+
+//primitives that evaluate all of their arguments
+static int evaluates_args(primitive *fn) {
+  return fn == prim_cons || fn == prim_car || fn == prim_cdr || fn == prim_setcar
+    || fn == prim_while || fn == prim_add || fn == prim_sub || fn == prim_mult
+    || fn == prim_lt || fn == prim_eq || fn == prim_cmp || fn == prim_print
+    || fn == prim_if || fn == prim_and || fn == prim_or || fn == prim_read_file || fn == prim_write_file
+    || fn == prim_substring || fn == prim_string_length
+    || fn == prim_string_split || fn == prim_string_concat || fn == prim_stream
+    || fn == prim_stream_range || fn == prim_stream_lines || fn == prim_stream_iterate
+    || fn == prim_stream_map || fn == prim_stream_filter || fn == prim_stream_take
+    || fn == prim_stream_reduce;
+}
+
+static obj_t *optimize(void *root, obj_t **env, obj_t **form, opt_scope_t *scope);
+
+// (<guarded> stamp body orig) is the body of functions rewritten by the
+// optimizer. body is run as long as opt_version is at stamp
+static obj_t *prim_guarded(void *root, obj_t **env, obj_t **list) {
+  DEFINE1(body);
+  if((unsigned int)(*list)->car->value == (unsigned int)opt_version)
+    *body = (*list)->cdr->car;
+  else
+    *body = (*list)->cdr->cdr->car;
+  return progn(root, env, body);
+}
+
+static obj_t *Guarded = &(obj_t) { TPRIMITIVE, .fn = prim_guarded };
+
+//body of a function as it was written
+static obj_t *plain_body(obj_t *body) {
+  if(body->type == TCELL && body->car->type == TCELL && body->car->car == Guarded)
+    return body->car->cdr->cdr->cdr->car;
+  return body;
+}
+
+//optimizes every element, the list is only copied if an element changed
+static obj_t *opt_list(void *root, obj_t **env, obj_t **list, opt_scope_t *scope) {
+  if((*list)->type != TCELL)
+    return *list;
+  DEFINE2(car, cdr);
+  *car = (*list)->car;
+  *car = optimize(root, env, car, scope);
+  *cdr = (*list)->cdr;
+  *cdr = opt_list(root, env, cdr, scope);
+  if(*car == (*list)->car && *cdr == (*list)->cdr)
+    return *list;
+  return cons(root, car, cdr);
+}
+
+// (lambda params expr ...), rest starts at params
+static obj_t *opt_lambda(void *root, obj_t **env, obj_t **rest, opt_scope_t *scope) {
+  if((*rest)->type != TCELL)
+    return *rest;
+  opt_scope_t inner = { (*rest)->car, scope };
+  DEFINE4(params, body, guard, tail);
+  *params = (*rest)->car;
+  *body = (*rest)->cdr;
+  *guard = make_int(root, opt_version);
+  opt_function++;
+  *body = opt_list(root, env, body, &inner);
+  opt_function--;
+  if(*body == (*rest)->cdr)
+    return *rest;
+  //the body runs long after it was rewritten, so it keeps the original
+  *tail = Nil;
+  *tail = cons(root, &(*rest)->cdr, tail);
+  *tail = cons(root, body, tail);
+  *tail = cons(root, guard, tail);
+  *tail = cons(root, &Guarded, tail);
+  *body = Nil;
+  *body = cons(root, tail, body);
+  return cons(root, params, body);
+}
+
+static int opt_size(obj_t *obj) {
+  int n = 0;
+  for(; obj->type == TCELL; obj = obj->cdr)
+    n += 1 + opt_size(obj->car);
+  return n;
+}
+
+//checks that body neither assigns, binds nor recurses and has no free
+//symbols captured at the call site
+static int opt_inlinable(obj_t **env, obj_t *body, obj_t *fn, obj_t *params, opt_scope_t *scope) {
+  if(body->type == TSYMBOL) {
+    opt_scope_t own = { params, 0 };
+    if(opt_bound(&own, body))
+      return 1;
+    obj_t *bind = find(env, body);
+    return !opt_bound(scope, body) && !(bind && bind->cdr == fn);
+  }
+  if(body->type != TCELL)
+    return 1;
+  obj_t *head = find(env, body->car) ? find(env, body->car)->cdr : 0;
+  if(is_prim(head, prim_quote))
+    return 1;
+  if(head && head->type == TPRIMITIVE && !evaluates_args(head->fn))
+    return 0;
+  if(is_prim(head, prim_while) || head == fn || (head && head->type == TMACRO))
+    return 0;
+  for(; body->type == TCELL; body = body->cdr)
+    if(!opt_inlinable(env, body->car, fn, params, scope))
+      return 0;
+  return 1;
+}
+
+//copy of body with the parameters replaced by args
+static obj_t *opt_subst(void *root, obj_t **env, obj_t **body, obj_t *params, obj_t *args) {
+  if((*body)->type == TSYMBOL) {
+    for(; params != Nil; params = params->cdr, args = args->cdr)
+      if(params->car == *body)
+        return args->car;
+    return *body;
+  }
+  if((*body)->type != TCELL || is_prim(opt_global(env, 0, (*body)->car), prim_quote))
+    return *body;
+  DEFINE2(car, cdr);
+  *car = (*body)->car;
+  *car = opt_subst(root, env, car, params, args);
+  *cdr = (*body)->cdr;
+  *cdr = opt_subst(root, env, cdr, params, args);
+  return cons(root, car, cdr);
+}
+
+//an argument that is dropped or moved by opt_subst must not be able to
+//fail, so it is bound by an enclosing let or loop or has a global value.
+//names assigned in the top level form, the outermost scope, may still be
+//unbound when the call runs
+static int opt_defined(obj_t **env, opt_scope_t *scope, obj_t *sym) {
+  for(; scope && scope->up; scope = scope->up) {
+    opt_scope_t own = { scope->params, 0 };
+    if(opt_bound(&own, sym))
+      return 1;
+  }
+  return find(env, sym) != 0;
+}
+
+// (<inlined> stamp expr call) is put around inlined calls by opt_inline
+static obj_t *prim_inlined(void *root, obj_t **env, obj_t **list) {
+  DEFINE1(expr);
+  if((unsigned int)(*list)->car->value == (unsigned int)global_version)
+    *expr = (*list)->cdr->car;
+  else
+    *expr = (*list)->cdr->cdr->car;
+  return eval(root, env, expr);
+}
+
+//not reachable by name, so user code can not rebind it
+static obj_t *Inlined = &(obj_t) { TPRIMITIVE, .fn = prim_inlined };
+
+static obj_t *opt_inline(void *root, obj_t **env, obj_t **form, obj_t **fn, opt_scope_t *scope) {
+  obj_t *params = (*fn)->params;
+  obj_t *body = plain_body((*fn)->body);
+  if(opt_function || !opt_stamp || opt_depth >= OPT_INLINE_DEPTH || (*fn)->env->up != Nil || body->type != TCELL
+      || body->cdr != Nil || opt_size(body->car) > OPT_INLINE_MAX
+      || length(params) < 0 || length(params) != length((*form)->cdr))
+    return 0;
+  for(obj_t *p = params; p != Nil; p = p->cdr)
+    if(p->car->type != TSYMBOL)
+      return 0;
+  for(obj_t *a = (*form)->cdr; a != Nil; a = a->cdr)
+    if(!is_constant(a->car) && (a->car->type != TSYMBOL || !opt_defined(env, scope, a->car)))
+      return 0;
+  if(!opt_inlinable(env, body->car, *fn, params, scope))
+    return 0;
+  DEFINE2(expr, guard);
+  *expr = body->car;
+  *expr = opt_subst(root, env, expr, params, (*form)->cdr);
+  opt_inlines++;
+  opt_depth++;
+  *expr = optimize(root, env, expr, scope);
+  opt_depth--;
+  *guard = Nil;
+  *guard = cons(root, form, guard);
+  *guard = cons(root, expr, guard);
+  *guard = cons(root, opt_stamp, guard);
+  return cons(root, &Inlined, guard);
+}
+
+// (let bindings expr ...), rest starts at the bindings
+static obj_t *opt_let(void *root, obj_t **env, obj_t **rest, opt_scope_t *scope) {
+  if((*rest)->type != TCELL || !is_list((*rest)->car))
+    return *rest;
+  DEFINE5(vars, binds, sym, bind, body);
+  *vars = Nil;
+  *binds = Nil;
+  for(obj_t *b = (*rest)->car; b->type == TCELL; b = b->cdr) {
+    *bind = b->car;
+    if((*bind)->type == TCELL) {
+      *sym = (*bind)->car;
+      *body = (*bind)->cdr;
+      *body = opt_list(root, env, body, scope);
+      *bind = cons(root, sym, body);
+    }
+    *sym = (*bind)->type == TCELL ? (*bind)->car : *bind;
+    *vars = cons(root, sym, vars);
+    *binds = cons(root, bind, binds);
+  }
+  *binds = reverse(*binds);
+  opt_scope_t inner = { *vars, scope };
+  *body = (*rest)->cdr;
+  *body = opt_list(root, env, body, &inner);
+  return cons(root, binds, body);
+}
+
+// (dotimes (var expr result) expr ...) and dolist, rest starts at (var ...)
+static obj_t *opt_loop(void *root, obj_t **env, obj_t **rest, opt_scope_t *scope) {
+  if((*rest)->type != TCELL || (*rest)->car->type != TCELL || (*rest)->car->cdr->type != TCELL)
+    return *rest;
+  DEFINE5(sym, vars, expr, result, body);
+  *sym = (*rest)->car->car;
+  *vars = Nil;
+  *vars = cons(root, sym, vars);
+  *expr = (*rest)->car->cdr->car;
+  *expr = optimize(root, env, expr, scope);
+  opt_scope_t inner = { *vars, scope };
+  *result = (*rest)->car->cdr->cdr;
+  *result = opt_list(root, env, result, &inner);
+  *body = (*rest)->cdr;
+  *body = opt_list(root, env, body, &inner);
+  *result = cons(root, expr, result);
+  *result = cons(root, sym, result);
+  return cons(root, result, body);
+}
+
+// (cond (test expr ...) ...), every clause is optimized as a list of forms
+static obj_t *opt_cond(void *root, obj_t **env, obj_t **clauses, opt_scope_t *scope) {
+  if((*clauses)->type != TCELL)
+    return *clauses;
+  DEFINE2(car, cdr);
+  *car = (*clauses)->car;
+  *car = opt_list(root, env, car, scope);
+  *cdr = (*clauses)->cdr;
+  *cdr = opt_cond(root, env, cdr, scope);
+  if(*car == (*clauses)->car && *cdr == (*clauses)->cdr)
+    return *clauses;
+  return cons(root, car, cdr);
+}
+
+// (if cond then else ...) with optimized arguments
+static obj_t *opt_if(obj_t **env, obj_t *args, opt_scope_t *scope) {
+  if(length(args) < 2)
+    return 0;
+  obj_t *cond = args->car;
+  if(cond->type == TSYMBOL && opt_global(env, scope, cond) == True)
+    cond = True;
+  if(!is_constant(cond))
+    return 0;
+  if(cond != Nil) {
+    opt_branches++;
+    return args->cdr->car;
+  }
+  obj_t *els = args->cdr->cdr;
+  if(els != Nil && els->cdr != Nil)
+    return 0;
+  opt_branches++;
+  return els == Nil ? Nil : els->car;
+}
+
+// (add ...), (sub ...), (mult ...), (lt a b), (eq a b) with integer arguments
+static obj_t *opt_fold(void *root, obj_t **env, obj_t **prim, obj_t **args) {
+  primitive *fn = (*prim)->fn;
+  int n = length(*args);
+  if(fn != prim_add && fn != prim_sub && fn != prim_mult && fn != prim_lt && fn != prim_eq)
+    return 0;
+  if(n < 0 || (fn == prim_sub && n < 1) || ((fn == prim_lt || fn == prim_eq) && n != 2))
+    return 0;
+  for(obj_t *p = *args; p != Nil; p = p->cdr)
+    if(p->car->type != TINT)
+      return 0;
+  opt_folds++;
+  return fn(root, env, args);
+}
+
+static obj_t *optimize(void *root, obj_t **env, obj_t **form, opt_scope_t *scope) {
+  if((*form)->type != TCELL)
+    return *form;
+  DEFINE3(fn, args, ret);
+  *fn = opt_global(env, scope, (*form)->car);
+  *args = (*form)->cdr;
+  if(*fn && (*fn)->type == TMACRO) {
+    *ret = apply_func(root, env, fn, args);
+    return optimize(root, env, ret, scope);
+  }
+
+  if(*fn && (*fn)->type == TPRIMITIVE) {
+    primitive *prim = (*fn)->fn;
+    if(prim == prim_quote) {
+      if(length(*args) != 1 || !is_constant((*args)->car))
+        return *form;
+      opt_quotes++;
+      return (*args)->car;
+    }
+    if(prim == prim_lambda) {
+      *args = opt_lambda(root, env, args, scope);
+    } else if(prim == prim_let) {
+      *args = opt_let(root, env, args, scope);
+    } else if(prim == prim_dotimes || prim == prim_dolist) {
+      *args = opt_loop(root, env, args, scope);
+    } else if(prim == prim_cond) {
+      *args = opt_cond(root, env, args, scope);
+    } else if(prim == prim_defun) {
+      if((*args)->type != TCELL)
+        return *form;
+      *ret = (*args)->cdr;
+      *ret = opt_lambda(root, env, ret, scope);
+      if(*ret != (*args)->cdr) {
+        *fn = (*args)->car;
+        *args = cons(root, fn, ret);
+      }
+    } else if(prim == prim_setq || prim == prim_define) {
+      if((*args)->type != TCELL)
+        return *form;
+      *ret = (*args)->cdr;
+      *ret = opt_list(root, env, ret, scope);
+      if(*ret != (*args)->cdr) {
+        *fn = (*args)->car;
+        *args = cons(root, fn, ret);
+      }
+    } else if(evaluates_args(prim)) {
+      *args = opt_list(root, env, args, scope);
+      obj_t *folded = prim == prim_if ? opt_if(env, *args, scope) : opt_fold(root, env, fn, args);
+      if(folded)
+        return folded;
+    }
+  } else {
+    //function calls, unless the head may still become a macro
+    if((*form)->car->type == TSYMBOL && !*fn && !opt_bound(scope, (*form)->car))
+      return *form;
+    *args = opt_list(root, env, args, scope);
+    if(*fn && (*fn)->type == TFUNCTION) {
+      *ret = *args == (*form)->cdr ? *form : cons(root, &(*form)->car, args);
+      obj_t *inlined = opt_inline(root, env, ret, fn, scope);
+      if(inlined)
+        return inlined;
+      return *ret;
+    }
+    if((*form)->car->type == TCELL) {
+      *fn = (*form)->car;
+      *fn = optimize(root, env, fn, scope);
+      if(*fn != (*form)->car || *args != (*form)->cdr)
+        return cons(root, fn, args);
+      return *form;
+    }
+  }
+  if(*args == (*form)->cdr)
+    return *form;
+  *fn = (*form)->car;
+  return cons(root, fn, args);
+}
+
+//collects the names form defines or assigns
+static void opt_assigned(void *root, obj_t **env, obj_t *form, obj_t **names) {
+  DEFINE1(sym);
+  if(form->type != TCELL)
+    return;
+  obj_t *head = opt_global(env, 0, form->car);
+  if((is_prim(head, prim_define) || is_prim(head, prim_defun) || is_prim(head, prim_defmacro)
+        || is_prim(head, prim_setq)) && form->cdr->type == TCELL && form->cdr->car->type == TSYMBOL) {
+    *sym = form->cdr->car;
+    *names = cons(root, sym, names);
+  }
+  for(; form->type == TCELL; form = form->cdr)
+    opt_assigned(root, env, form->car, names);
+}
+
+static obj_t *opt_toplevel(void *root, obj_t **env, obj_t **form) {
+  DEFINE3(names, stamp, ret);
+  *names = Nil;
+  opt_assigned(root, env, *form, names);
+  //inlined bodies are also dropped if optimizing itself changed a binding
+  *stamp = make_int(root, global_version);
+  opt_stamp = stamp;
+  opt_scope_t scope = { *names, 0 };
+  *ret = optimize(root, env, form, &scope);
+  opt_stamp = 0;
+  return *ret;
+}
+
+//---------------------------------------- 
+// JIT
+//---------------------------------------- 
+
+// Functions called more than jit_threshold times are compiled to x86-64.
+// Only bodies built from integers, t, (), parameters, add/sub/mult, lt/eq, if,
+// while, setq of parameters and calls of the function itself are
+// compiled. The code works on unboxed ints, so it is entered only when
+// every argument is a TINT and the global bindings it was compiled
+// against are unchanged; otherwise the interpreter runs the call.
+//
+// Compiled code takes a pointer to the arguments (last one first) and
+// returns the result in eax, 0/1 for t/nil results. On other hosts
+// nothing is compiled and --jit is rejected.
+
+enum {
+  KFAIL = 0,
+  KINT,
+  KBOOL,
+};
+
+static int jit_threshold = 100;
+static int jit_verify = 0;
+static int jit_compiled = 0;
+static unsigned long jit_native_calls = 0;
+static unsigned long jit_fallbacks = 0;
+
+#if defined(__x86_64__)
+
+typedef struct jit_ctx_t {
+  obj_t *fn;
+  jit_t *jit;
+  int kind;           // assumed result kind of calls to fn itself
+  int depth;          // 8 byte slots pushed on top of the frame
+  unsigned char *buf;
+  size_t len;
+  size_t cap;
+} jit_ctx_t;
+
+static void emit(jit_ctx_t *c, int n, ...) {
+  if(c->len + n > c->cap) {
+    c->cap = c->cap ? c->cap * 2 : 4096;
+    c->buf = realloc(c->buf, c->cap);
+    if(!c->buf)
+      error("allocation failed");
+  }
+  va_list ap;
+  va_start(ap, n);
+  for(int i = 0; i < n; i++)
+    c->buf[c->len++] = va_arg(ap, int);
+  va_end(ap);
+}
+
+static void emit32(jit_ctx_t *c, int v) {
+  emit(c, 4, v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, (v >> 24) & 0xff);
+}
+
+static void patch32(jit_ctx_t *c, size_t pos, int v) {
+  for(int i = 0; i < 4; i++)
+    c->buf[pos + i] = (v >> (8 * i)) & 0xff;
+}
+
+// jcc/jmp with a rel32 operand, returns the position to patch
+static size_t emit_jump(jit_ctx_t *c, int n, ...) {
+  va_list ap;
+  va_start(ap, n);
+  for(int i = 0; i < n; i++)
+    emit(c, 1, va_arg(ap, int));
+  va_end(ap);
+  emit32(c, 0);
+  return c->len - 4;
+}
+
+static void patch_jump(jit_ctx_t *c, size_t pos, size_t target) {
+  patch32(c, pos, (int)(target - (pos + 4)));
+}
+
+static int jit_param(jit_ctx_t *c, obj_t *sym) {
+  int i = 0;
+  for(obj_t *p = c->fn->params; p != Nil; p = p->cdr, i++)
+    if(p->car == sym)
+      return i;
+  return -1;
+}
+
+static int slot(int param) {
+  return -8 * (param + 1);
+}
+
+// resolves sym in the environment of fn and remembers the binding as a guard
+static obj_t *jit_resolve(jit_ctx_t *c, obj_t *sym) {
+  obj_t *frame;
+  obj_t *bind = find_frame(&c->fn->env, sym, &frame);
+  if(!bind || frame->up != Nil)
+    return 0;
+  jit_t *jit = c->jit;
+  for(int i = 0; i < jit->nguards; i++)
+    if(jit->guards[i].sym == sym)
+      return bind->cdr;
+  if(jit->nguards == JIT_MAX_GUARDS)
+    return 0;
+  jit->guards[jit->nguards++] = (jit_guard_t) { sym, bind, bind->cdr };
+  return bind->cdr;
+}
+
+static int jit_expr(jit_ctx_t *c, obj_t *e);
+
+static int jit_body(jit_ctx_t *c, obj_t *body) {
+  int kind = KFAIL;
+  if(body == Nil)
+    return KFAIL;
+  for(; body->type == TCELL; body = body->cdr)
+    if(!(kind = jit_expr(c, body->car)))
+      return KFAIL;
+  return body == Nil ? kind : KFAIL;
+}
+
+// (add ...), (sub ...), (mult ...)
+static int jit_arith(jit_ctx_t *c, primitive *fn, obj_t *args) {
+  int n = length(args);
+  if(n < 0 || (fn == prim_sub && n == 0))
+    return KFAIL;
+  if(n == 0) {
+    emit(c, 1, 0xb8);                                   // mov eax, imm32
+    emit32(c, fn == prim_mult ? 1 : 0);
+    return KINT;
+  }
+  if(jit_expr(c, args->car) != KINT)
+    return KFAIL;
+  if(fn == prim_sub && n == 1) {
+    emit(c, 2, 0xf7, 0xd8);                             // neg eax
+    return KINT;
+  }
+  for(args = args->cdr; args != Nil; args = args->cdr) {
+    emit(c, 1, 0x50);                                   // push rax
+    c->depth++;
+    if(jit_expr(c, args->car) != KINT)
+      return KFAIL;
+    emit(c, 1, 0x59);                                   // pop rcx
+    c->depth--;
+    if(fn == prim_add)
+      emit(c, 2, 0x01, 0xc8);                           // add eax, ecx
+    else if(fn == prim_mult)
+      emit(c, 3, 0x0f, 0xaf, 0xc1);                     // imul eax, ecx
+    else
+      emit(c, 4, 0x29, 0xc1, 0x89, 0xc8);               // sub ecx, eax; mov eax, ecx
+  }
+  return KINT;
+}
+
+// (lt a b), (eq a b)
+static int jit_compare(jit_ctx_t *c, primitive *fn, obj_t *args) {
+  if(length(args) != 2 || jit_expr(c, args->car) != KINT)
+    return KFAIL;
+  emit(c, 1, 0x50);                                     // push rax
+  c->depth++;
+  if(jit_expr(c, args->cdr->car) != KINT)
+    return KFAIL;
+  emit(c, 1, 0x59);                                     // pop rcx
+  c->depth--;
+  emit(c, 2, 0x39, 0xc1);                               // cmp ecx, eax
+  emit(c, 3, 0x0f, fn == prim_lt ? 0x9c : 0x94, 0xc0);  // setl/sete al
+  emit(c, 3, 0x0f, 0xb6, 0xc0);                         // movzx eax, al
+  return KBOOL;
+}
+
+// (if cond then else ...)
+static int jit_if(jit_ctx_t *c, obj_t *args) {
+  if(length(args) < 2 || jit_expr(c, args->car) != KBOOL)
+    return KFAIL;
+  emit(c, 2, 0x85, 0xc0);                               // test eax, eax
+  size_t to_else = emit_jump(c, 2, 0x0f, 0x84);         // je else
+  int then = jit_expr(c, args->cdr->car);
+  size_t to_end = emit_jump(c, 1, 0xe9);                // jmp end
+  patch_jump(c, to_else, c->len);
+  int els = KBOOL;
+  if(args->cdr->cdr == Nil) {
+    emit(c, 2, 0x31, 0xc0);                             // xor eax, eax
+  } else {
+    els = jit_body(c, args->cdr->cdr);
+  }
+  patch_jump(c, to_end, c->len);
+  return then == els ? then : KFAIL;
+}
+
+// (while cond expr ...)
+static int jit_while(jit_ctx_t *c, obj_t *args) {
+  if(length(args) < 2)
+    return KFAIL;
+  size_t loop = c->len;
+  if(jit_expr(c, args->car) != KBOOL)
+    return KFAIL;
+  emit(c, 2, 0x85, 0xc0);                               // test eax, eax
+  size_t to_end = emit_jump(c, 2, 0x0f, 0x84);          // je end
+  if(!jit_body(c, args->cdr))
+    return KFAIL;
+  size_t to_loop = emit_jump(c, 1, 0xe9);               // jmp loop
+  patch_jump(c, to_loop, loop);
+  patch_jump(c, to_end, c->len);
+  emit(c, 2, 0x31, 0xc0);                               // xor eax, eax
+  return KBOOL;
+}
+
+// (setq <parameter> expr)
+static int jit_setq(jit_ctx_t *c, obj_t *args) {
+  if(length(args) != 2 || args->car->type != TSYMBOL)
+    return KFAIL;
+  int param = jit_param(c, args->car);
+  if(param < 0 || jit_expr(c, args->cdr->car) != KINT)
+    return KFAIL;
+  emit(c, 2, 0x89, 0x85);                               // mov [rbp+disp32], eax
+  emit32(c, slot(param));
+  return KINT;
+}
+
+// (fn expr ...) where fn is the function being compiled
+static int jit_self_call(jit_ctx_t *c, obj_t *args) {
+  int n = length(args);
+  if(n != c->jit->nparams)
+    return KFAIL;
+  for(; args != Nil; args = args->cdr) {
+    if(jit_expr(c, args->car) != KINT)
+      return KFAIL;
+    emit(c, 1, 0x50);                                   // push rax
+    c->depth++;
+  }
+  int pad = c->depth % 2;
+  if(pad)
+    emit(c, 4, 0x48, 0x83, 0xec, 0x08);                 // sub rsp, 8
+  emit(c, 5, 0x48, 0x8d, 0x7c, 0x24, pad * 8);          // lea rdi, [rsp+pad]
+  emit(c, 1, 0xe8);                                     // call entry
+  emit32(c, -(int)(c->len + 4));
+  emit(c, 3, 0x48, 0x81, 0xc4);                         // add rsp, imm32
+  emit32(c, 8 * (n + pad));
+  c->depth -= n;
+  return c->kind;
+}
+
+static int jit_expr(jit_ctx_t *c, obj_t *e) {
+  if(e->type == TINT) {
+    emit(c, 1, 0xb8);                                   // mov eax, imm32
+    emit32(c, e->value);
+    return KINT;
+  }
+  if(e == Nil) {
+    emit(c, 2, 0x31, 0xc0);                             // xor eax, eax
+    return KBOOL;
+  }
+  if(e->type == TSYMBOL) {
+    int param = jit_param(c, e);
+    if(param >= 0) {
+      emit(c, 2, 0x8b, 0x85);                           // mov eax, [rbp+disp32]
+      emit32(c, slot(param));
+      return KINT;
+    }
+    if(jit_resolve(c, e) != True)
+      return KFAIL;
+    emit(c, 1, 0xb8);                                   // mov eax, 1
+    emit32(c, 1);
+    return KBOOL;
+  }
+  if(e->type != TCELL || e->car->type != TSYMBOL || jit_param(c, e->car) >= 0)
+    return KFAIL;
+  obj_t *fn = jit_resolve(c, e->car);
+  if(!fn)
+    return KFAIL;
+  if(fn == c->fn)
+    return jit_self_call(c, e->cdr);
+  if(fn->type != TPRIMITIVE)
+    return KFAIL;
+  if(fn->fn == prim_add || fn->fn == prim_sub || fn->fn == prim_mult)
+    return jit_arith(c, fn->fn, e->cdr);
+  if(fn->fn == prim_lt || fn->fn == prim_eq)
+    return jit_compare(c, fn->fn, e->cdr);
+  if(fn->fn == prim_if)
+    return jit_if(c, e->cdr);
+  if(fn->fn == prim_while)
+    return jit_while(c, e->cdr);
+  if(fn->fn == prim_setq)
+    return jit_setq(c, e->cdr);
+  return KFAIL;
+}
+
+static int jit_function(jit_ctx_t *c) {
+  int n = c->jit->nparams;
+  int frame = 8 * (n + n % 2);
+  c->len = 0;
+  c->depth = 0;
+  c->jit->nguards = 0;
+  emit(c, 4, 0x55, 0x48, 0x89, 0xe5);                   // push rbp; mov rbp, rsp
+  emit(c, 3, 0x48, 0x81, 0xec);                         // sub rsp, imm32
+  emit32(c, frame);
+  for(int i = 0; i < n; i++) {
+    emit(c, 2, 0x8b, 0x87);                             // mov eax, [rdi+disp32]
+    emit32(c, 8 * (n - 1 - i));
+    emit(c, 2, 0x89, 0x85);                             // mov [rbp+disp32], eax
+    emit32(c, slot(i));
+  }
+  //the optimized body is compiled while it is the one that runs
+  obj_t *body = plain_body(c->fn->body);
+  c->jit->stamp = 0;
+  if(body != c->fn->body) {
+    obj_t *guard = c->fn->body->car->cdr;
+    if((unsigned int)guard->car->value == (unsigned int)opt_version) {
+      c->jit->stamp = guard->car;
+      body = guard->cdr->car;
+    }
+  }
+  int kind = jit_body(c, body);
+  emit(c, 2, 0xc9, 0xc3);                               // leave; ret
+  return kind;
+}
+
+static jit_t *jit_compile(obj_t *fn) {
+  int n = 0;
+  obj_t *p = fn->params;
+  for(; p->type == TCELL; p = p->cdr)
+    n++;
+  if(p != Nil || n > JIT_MAX_PARAMS)
+    return 0;
+
+  jit_t *jit = malloc(sizeof(jit_t));
+  if(!jit)
+    error("allocation failed");
+  jit->nparams = n;
+  jit->version = 0;
+  jit_ctx_t c = { fn, jit };
+
+  //the result kind of recursive calls is not known upfront, so try both
+  jit->kind = KFAIL;
+  for(c.kind = KINT; c.kind <= KBOOL && !jit->kind; c.kind++)
+    if(jit_function(&c) == c.kind)
+      jit->kind = c.kind;
+  if(!jit->kind) {
+    free(c.buf);
+    free(jit);
+    return 0;
+  }
+
+  long page = sysconf(_SC_PAGESIZE);
+  jit->size = (c.len + page - 1) / page * page;
+  void *code = mmap(0, jit->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(code == MAP_FAILED)
+    error("unable to map jit code");
+  memcpy(code, c.buf, c.len);
+  if(mprotect(code, jit->size, PROT_READ | PROT_EXEC))
+    error("unable to protect jit code");
+  free(c.buf);
+  jit->code = (int (*)(long*))code;
+  jit_compiled++;
+  return jit;
+}
+
+static void jit_free(jit_t *jit) {
+  munmap((void*)jit->code, jit->size);
+  free(jit);
+}
+
+#else
+
+static jit_t *jit_compile(obj_t *fn) {
+  return 0;
+}
+
+static void jit_free(jit_t *jit) {
+}
+
+#endif
+
+//runs the native code of fn, returns 0 if a guard does not hold
+static obj_t *jit_run(void *root, obj_t **fn, obj_t **args) {
+  jit_t *jit = (*fn)->jit;
+  long values[JIT_MAX_PARAMS];
+  int n = 0;
+  for(obj_t *p = *args; p != Nil; p = p->cdr) {
+    if(n == jit->nparams || p->car->type != TINT)
+      return 0;
+    values[jit->nparams - 1 - n++] = p->car->value;
+  }
+  if(n != jit->nparams)
+    return 0;
+  if(jit->version != global_version) {
+    if(jit->stamp && (unsigned int)jit->stamp->value != (unsigned int)opt_version)
+      return 0;
+    for(int i = 0; i < jit->nguards; i++) {
+      jit_guard_t *g = &jit->guards[i];
+      if(g->bind->cdr != g->value || find(&(*fn)->env, g->sym) != g->bind)
+        return 0;
+    }
+    jit->version = global_version;
+  }
+  int ret = jit->code(values);
+  jit_native_calls++;
+  if(jit->kind == KBOOL)
+    return ret ? True : Nil;
+  return make_int(root, ret);
+}
+
+static obj_t *jit_call(void *root, obj_t **fn, obj_t **args) {
+  if(!(*fn)->jit) {
+    if((*fn)->calls > jit_threshold)
+      return 0;
+    if((*fn)->calls++ < jit_threshold)
+      return 0;
+    if(!((*fn)->jit = jit_compile(*fn)))
+      return 0;
+  }
+  DEFINE2(native, expected);
+  *native = jit_run(root, fn, args);
+  if(!*native) {
+    jit_fallbacks++;
+    return 0;
+  }
+  if(jit_verify) {
+    jit_suspended++;
+    *expected = interpret_func(root, fn, args);
+    jit_suspended--;
+    if((*native)->type != (*expected)->type
+        || ((*native)->type == TINT ? (*native)->value != (*expected)->value : *native != *expected))
+      error("jit: native result differs from the interpreter");
+  }
+  return *native;
+}
+
 static void add_primitive(void *root, obj_t **env, char *name, primitive *fn) {
   DEFINE2(sym, prim);
   *sym = intern(root, name);
@@ -836,6 +3324,8 @@ static void define_primitives(void *root, obj_t **env) {
   add_primitive(root, env, "setq", prim_setq);
   add_primitive(root, env, "setcar", prim_setcar);
   add_primitive(root, env, "while", prim_while);
+  add_primitive(root, env, "dotimes", prim_dotimes);
+  add_primitive(root, env, "dolist", prim_dolist);
   add_primitive(root, env, "gensym", prim_gensym);
   add_primitive(root, env, "add", prim_add);
   add_primitive(root, env, "sub", prim_sub);
@@ -847,52 +3337,351 @@ static void define_primitives(void *root, obj_t **env) {
   add_primitive(root, env, "macroexpand", prim_macroexpand);
   add_primitive(root, env, "lambda", prim_lambda);
   add_primitive(root, env, "if", prim_if);
+  add_primitive(root, env, "let", prim_let);
+  add_primitive(root, env, "cond", prim_cond);
+  add_primitive(root, env, "and", prim_and);
+  add_primitive(root, env, "or", prim_or);
   add_primitive(root, env, "eq", prim_eq);
   add_primitive(root, env, "cmp", prim_cmp);
   add_primitive(root, env, "quit", prim_quit);
   add_primitive(root, env, "print", prim_print);
+  add_primitive(root, env, "read-file", prim_read_file);
+  add_primitive(root, env, "write-file", prim_write_file);
+  add_primitive(root, env, "substring", prim_substring);
+  add_primitive(root, env, "string-length", prim_string_length);
+  add_primitive(root, env, "string-split", prim_string_split);
+  add_primitive(root, env, "string-concat", prim_string_concat);
+  add_primitive(root, env, "stream", prim_stream);
+  add_primitive(root, env, "stream-range", prim_stream_range);
+  add_primitive(root, env, "stream-lines", prim_stream_lines);
+  add_primitive(root, env, "stream-iterate", prim_stream_iterate);
+  add_primitive(root, env, "stream-map", prim_stream_map);
+  add_primitive(root, env, "stream-filter", prim_stream_filter);
+  add_primitive(root, env, "stream-take", prim_stream_take);
+  add_primitive(root, env, "stream-reduce", prim_stream_reduce);
+}
+
+//---------------------------------------- 
+// SERVER
+//---------------------------------------- 
+
+// Requests and responses are framed by a 4 byte big endian length of
+// the bytes that follow. A request holds source text whose forms are
+// evaluated like in batch mode. A response starts with a status byte,
+// 0 on success and 1 on error, followed by the output, the printed
+// values and the error message if evaluation failed. (quit) ends the
+// connection after its response instead of the server.
+
+#define SERVE_MAX_REQUEST (64 << 20)
+#define SERVE_MAX_EVENTS 64
+
+typedef struct client_t {
+  int fd;
+  int events;     // epoll events the client is registered for
+  int eof;        // nothing more to read, close once the output is sent
+  buffer_t in;
+  buffer_t out;
+  size_t out_done;
+} client_t;
+
+static void repl(void *root, obj_t **env, int echo, int prompt);
+
+//returns 1 if the request called quit
+static int serve_request(void *root, obj_t **env, buffer_t *res, char *req, size_t len) {
+  size_t start = res->len;
+  buffer_add(res, "\0\0\0\0\0", 5);
+  out_sink = res;
+  jmp_buf handler;
+  FILE *in = len ? fmemopen(req, len, "r") : 0;
+  int quit = 0;
+  if(in) {
+    switch(setjmp(handler)) {
+      case 0:
+        input = in;
+        error_handler = &handler;
+        repl(root, env, 1, 0);
+        break;
+      case QUIT_REQUEST:
+        quit = 1;
+        break;
+      default:
+        res->data[start + 4] = 1;
+        out_puts("error: ");
+        out_puts(error_msg);
+        out_putc('\n');
+        break;
+    }
+    opt_depth = 0;
+    opt_function = 0;
+    opt_stamp = 0;
+    jit_suspended = 0;
+    eval_depth = 0;
+  }
+  error_handler = 0;
+  out_flush();
+  out_sink = 0;
+  if(in)
+    fclose(in);
+  input = stdin;
+  uint32_t n = res->len - start - 4;
+  for(int i = 0; i < 4; i++)
+    res->data[start + i] = n >> (24 - 8 * i);
+  return quit;
+}
+
+static void client_close(client_t *c) {
+  close(c->fd);
+  free(c->in.data);
+  free(c->out.data);
+  free(c);
+}
+
+//returns 0 if the client is done
+static int client_write(int ep, client_t *c) {
+  while(c->out_done < c->out.len) {
+    ssize_t n = send(c->fd, c->out.data + c->out_done, c->out.len - c->out_done, MSG_NOSIGNAL);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n < 0 && errno == EAGAIN)
+      break;
+    if(n < 0)
+      return 0;
+    c->out_done += n;
+  }
+  if(c->out_done == c->out.len)
+    c->out_done = c->out.len = 0;
+  if(c->eof && !c->out.len)
+    return 0;
+  int events = (c->eof ? 0 : EPOLLIN) | (c->out.len ? EPOLLOUT : 0);
+  if(events != c->events) {
+    struct epoll_event ev = { .events = events, .data.ptr = c };
+    epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = events;
+  }
+  return 1;
+}
+
+//evaluates every complete request, returns 0 on a malformed request
+static int client_read(void *root, obj_t **env, client_t *c) {
+  for(;;) {
+    if(c->in.cap - c->in.len < 4096)
+      buffer_reserve(&c->in, 4096);
+    ssize_t n = read(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n < 0 && errno == EAGAIN)
+      break;
+    if(n <= 0) {
+      c->eof = 1;
+      break;
+    }
+    c->in.len += n;
+  }
+  size_t done = 0;
+  while(c->in.len - done >= 4) {
+    unsigned char *p = (unsigned char*)c->in.data + done;
+    size_t len = (size_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+    if(len > SERVE_MAX_REQUEST)
+      return 0;
+    if(c->in.len - done - 4 < len)
+      break;
+    done += 4 + len;
+    //requests after a quit are dropped, the connection closes once the
+    //response is sent
+    if(serve_request(root, env, &c->out, (char*)p + 4, len)) {
+      c->eof = 1;
+      done = c->in.len;
+      break;
+    }
+  }
+  memmove(c->in.data, c->in.data + done, c->in.len - done);
+  c->in.len -= done;
+  return 1;
+}
+
+//answers eval requests on a unix socket, never returns
+static void serve(void *root, obj_t **env, char *path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if(strlen(path) >= sizeof(addr.sun_path))
+    error("socket path too long: %s", path);
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if(fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, SOMAXCONN))
+    error("unable to listen on %s", path);
+  int ep = epoll_create1(0);
+  struct epoll_event ev = { .events = EPOLLIN, .data.ptr = 0 };
+  if(ep < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev))
+    error("unable to poll %s", path);
+
+  struct epoll_event events[SERVE_MAX_EVENTS];
+  for(;;) {
+    int n = epoll_wait(ep, events, SERVE_MAX_EVENTS, -1);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n < 0)
+      error("epoll failed");
+    for(int i = 0; i < n; i++) {
+      client_t *c = events[i].data.ptr;
+      if(!c) {
+        int cfd;
+        while((cfd = accept(fd, 0, 0)) >= 0) {
+          fcntl(cfd, F_SETFL, O_NONBLOCK);
+          c = calloc(1, sizeof(client_t));
+          if(!c)
+            error("allocation failed");
+          c->fd = cfd;
+          c->events = EPOLLIN;
+          ev = (struct epoll_event) { .events = EPOLLIN, .data.ptr = c };
+          epoll_ctl(ep, EPOLL_CTL_ADD, cfd, &ev);
+        }
+        continue;
+      }
+      int ok = 1;
+      if(!c->eof && events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        ok = client_read(root, env, c);
+      if(!ok || !client_write(ep, c))
+        client_close(c);
+    }
+  }
 }
 
 //---------------------------------------- 
 // ENTRY POINT
 //---------------------------------------- 
 
+//reads and evaluates forms from input until it is exhausted
+static void repl(void *root, obj_t **env, int echo, int prompt) {
+  DEFINE1(expr);
+  for(;;) {
+    if(prompt) {
+      out_puts("> ");
+      out_flush();
+    }
+    *expr = read_exp(root);
+    if(!*expr) 
+      return;
+    if(*expr == Cparen)
+      error("stry close paranthesis");
+    if(*expr == Dot)
+      error("stray dot");
+    if(opt_enabled)
+      *expr = opt_toplevel(root, env, expr);
+    *expr = eval(root, env, expr);
+    if(echo) {
+      print(*expr);
+      out_putc('\n');
+    }
+  }
+}
+
+static void load(void *root, obj_t **env, char *path) {
+  input = fopen(path, "r");
+  if(!input)
+    error("unable to open %s", path);
+  repl(root, env, 0, 0);
+  fclose(input);
+  input = stdin;
+}
+
+static void report_stats(void) {
+  fprintf(stderr, "gc: %lu collections, pause total %.3f ms, max %.3f ms, avg %.3f ms, %lu region(s)\n",
+      gc_count, gc_pause_total, gc_pause_max,
+      gc_count ? gc_pause_total / gc_count : 0.0, region_count);
+  for(int i = 1; i <= gc_threads; i++)
+    if(gc_count_by[i])
+      fprintf(stderr, "gc: %d thread(s): %lu collections, pause total %.3f ms, avg %.3f ms\n",
+          i, gc_count_by[i], gc_pause_by[i], gc_pause_by[i] / gc_count_by[i]);
+  if(opt_enabled)
+    fprintf(stderr, "opt: %lu rewrites, %lu folds, %lu branches, %lu quotes, %lu inlines\n",
+        opt_folds + opt_branches + opt_quotes + opt_inlines,
+        opt_folds, opt_branches, opt_quotes, opt_inlines);
+  if(jit_enabled)
+    fprintf(stderr, "jit: %d function(s) compiled, %lu native calls, %lu fallbacks\n",
+        jit_compiled, jit_native_calls, jit_fallbacks);
+}
+
 int main(int argc, char **argv) {
 
+  int batch = 0;
+  char *serve_path = 0;
+  int nfiles = 0;
+  char **files = calloc(argc, sizeof(char*));
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "--gc-threads") && i + 1 < argc)
+      gc_threads = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--heap") && i + 1 < argc)
+      max_mem = strtoul(argv[++i], 0, 10);
+    else if(!strcmp(argv[i], "--jit"))
+      jit_enabled = 1;
+    else if(!strcmp(argv[i], "--jit-threshold") && i + 1 < argc)
+      jit_threshold = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--jit-verify"))
+      jit_enabled = jit_verify = 1;
+    else if(!strcmp(argv[i], "--no-opt"))
+      opt_enabled = 0;
+    else if(!strcmp(argv[i], "--print-circle"))
+      print_circle = 1;
+    else if(!strcmp(argv[i], "--stats"))
+      print_stats = 1;
+    else if(!strcmp(argv[i], "--batch"))
+      batch = 1;
+    else if(!strcmp(argv[i], "--serve") && i + 1 < argc)
+      serve_path = argv[++i];
+    else if(argv[i][0] != '-')
+      files[nfiles++] = argv[i];
+    else
+      error("unknown option: %s", argv[i]);
+  }
+  if(gc_threads < 1 || gc_threads > GC_MAX_THREADS)
+    error("gc threads must be between 1 and %d", GC_MAX_THREADS);
+  struct rlimit stack;
+  if(!getrlimit(RLIMIT_STACK, &stack) && stack.rlim_cur != RLIM_INFINITY)
+    eval_max_depth = stack.rlim_cur / EVAL_FRAME_SIZE;
+#if !defined(__x86_64__)
+  if(jit_enabled)
+    error("the jit needs an x86-64 host");
+#endif
+  if(print_stats)
+    atexit(report_stats);
+  atexit(out_flush);
+  input = stdin;
+
+  if(!batch && !serve_path) {
 #ifdef WINDOWS
-  system("cls");
+    system("cls");
 #else
-  system("clear");
+    system("clear");
 #endif
 
-  printf("___________________________\n");
-  printf("          _ _           \n");
-  printf("    _ __ | (_)___ _ __  \n");
-  printf("   | '_ \\| | / __| '_ \\ \n");
-  printf("   | |_) | | \\__ \\ |_) |\n");
-  printf("   | .__/|_|_|___/ .__/ \n");
-  printf("   |_|           |_|    \n");
-  printf("___________________________\n");
+    out_puts("___________________________\n");
+    out_puts("          _ _           \n");
+    out_puts("    _ __ | (_)___ _ __  \n");
+    out_puts("   | '_ \\| | / __| '_ \\ \n");
+    out_puts("   | |_) | | \\__ \\ |_) |\n");
+    out_puts("   | .__/|_|_|___/ .__/ \n");
+    out_puts("   |_|           |_|    \n");
+    out_puts("___________________________\n");
+  }
 
   // constants and primitives
   symbols = Nil;
   void *root = 0;
-  DEFINE2(env, expr);
+  DEFINE1(env);
   *env = make_env(root, &Nil, &Nil);
   define_constants(root, env);
   define_primitives(root, env);
 
-  // main loop
-  for(;;) {
-    printf("> ");
-    *expr = read_exp(root);
-    if(!*expr) 
-      return 0;
-    if(*expr == Cparen)
-      error("stry close paranthesis");
-    if(*expr == Dot)
-      error("stray dot");
-    print(eval(root, env, expr));
-    printf("\n");
+  for(int i = 0; i < nfiles; i++)
+    load(root, env, files[i]);
+
+  if(serve_path) {
+    out_flush();
+    serve(root, env, serve_path);
   }
+
+  // main loop, a batch run with files does not read stdin
+  if(!batch || !nfiles)
+    repl(root, env, 1, !batch);
+  return 0;
 }
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Runs every program in tests/jit with the plain interpreter, then with
+# the JIT compiling on the first call and checking each native result
+# against the interpreter, with and without the optimizer, and fails if
+# any output differs from the plain run.
+#
+#   tests/jit-diff.sh [path to plisp]
+
+dir=$(dirname "$0")
+plisp=${1:-./plisp}
+heap=4000000
+
+if [ ! -x "$plisp" ]; then
+  echo "usage: $0 [path to plisp]" >&2
+  exit 2
+fi
+
+failed=0
+for prog in "$dir"/jit/*.lisp; do
+  expected=$("$plisp" --batch --no-opt --heap $heap "$prog" 2>&1)
+  for opt in --no-opt ""; do
+    actual=$("$plisp" --batch $opt --heap $heap --jit --jit-verify --jit-threshold 1 "$prog" 2>&1)
+    if [ "$expected" = "$actual" ]; then
+      echo "ok   $prog $opt"
+    else
+      echo "FAIL $prog $opt"
+      echo "$expected" > /tmp/jit-diff-expected.$$
+      echo "$actual" > /tmp/jit-diff-actual.$$
+      diff /tmp/jit-diff-expected.$$ /tmp/jit-diff-actual.$$
+      rm -f /tmp/jit-diff-expected.$$ /tmp/jit-diff-actual.$$
+      failed=1
+    fi
+  done
+done
+exit $failed
@@ -0,0 +1,15 @@
+; add/sub/mult over parameters and constants, including negatives
+(defun lin (a b) (add (mult a 3) (sub b 7) -2))
+(defun neg (x) (sub x))
+(defun poly (x) (add (mult x x x) (mult -4 x x) (mult 5 x) 11))
+(defun many (a b c d) (sub (add a b) (mult c d) 1))
+(print (lin 1 2))
+(print (lin -5 100))
+(print (neg 42))
+(print (neg -42))
+(print (poly 0))
+(print (poly 7))
+(print (poly -9))
+(print (many 1 2 3 4))
+(print (many 1000 -2000 30 -40))
+(print (add (lin 3 4) (poly 3) (many 5 6 7 8)))
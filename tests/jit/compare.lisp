@@ -0,0 +1,16 @@
+; functions returning t/() are compiled with boolean results
+(defun less (a b) (lt a b))
+(defun same (a b) (eq a b))
+(defun between (lo x hi) (if (lt x lo) () (lt x hi)))
+(defun always (x) t)
+(defun never (x) ())
+(print (less 1 2))
+(print (less 2 1))
+(print (less -3 -3))
+(print (same 5 5))
+(print (same 5 -5))
+(print (between 0 5 10))
+(print (between 0 -1 10))
+(print (between 0 10 10))
+(print (always 1))
+(print (never 1))
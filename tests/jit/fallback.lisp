@@ -0,0 +1,13 @@
+; arguments and results the native code can not handle run interpreted
+(defun id (x) x)
+(defun first (x) (if (eq 0 0) x x))
+(defun add1 (x) (add x 1))
+(print (id 5))
+(print (id 'sym))
+(print (id '(1 2)))
+(print (first "text"))
+(print (add1 1))
+(print (add1 -1))
+(define n 1)
+(dotimes (i 50) (setq n (add1 n)))
+(print n)
@@ -0,0 +1,16 @@
+; compiled code depends on global bindings and must notice changes
+(define scale 3)
+(defun scaled (x) (mult x scale))
+(print (scaled 2))
+(print (scaled 5))
+(setq scale 10)
+(print (scaled 2))
+(define scale 7)
+(print (scaled 2))
+(defun helper (x) (add x 1))
+(defun use (x) (helper x))
+(print (use 1))
+(print (use 2))
+(defun helper (x) (add x 100))
+(print (use 1))
+(print (scaled 4))
@@ -0,0 +1,15 @@
+; nested and multi form else branches
+(defun sign (x) (if (lt x 0) -1 (if (eq x 0) 0 1)))
+(defun clamp (x lo hi) (if (lt x lo) lo (if (lt hi x) hi x)))
+(defun pick (c a b) (if (eq c 0) a (sub 0 1) b))
+(defun abs (x) (if (lt x 0) (sub x) x))
+(print (sign -7))
+(print (sign 0))
+(print (sign 9))
+(print (clamp 5 0 10))
+(print (clamp -5 0 10))
+(print (clamp 50 0 10))
+(print (pick 0 1 2))
+(print (pick 1 1 2))
+(print (abs -12))
+(print (abs 12))
@@ -0,0 +1,12 @@
+; self calls, deep and branching
+(defun fib (n) (if (lt n 2) n (add (fib (sub n 1)) (fib (sub n 2)))))
+(defun fact (n) (if (eq n 0) 1 (mult n (fact (sub n 1)))))
+(defun ack (m n) (if (eq m 0) (add n 1) (if (eq n 0) (ack (sub m 1) 1) (ack (sub m 1) (ack m (sub n 1))))))
+(defun even (n) (if (eq n 0) t (if (eq n 1) () (even (sub n 2)))))
+(defun count-down (n) (if (eq n 0) 0 (count-down (sub n 1))))
+(print (fib 20))
+(print (fact 10))
+(print (ack 2 3))
+(print (even 100))
+(print (even 77))
+(print (count-down 3000))
@@ -0,0 +1,29 @@
+; inlined calls must follow later redefinitions and runtime defines
+(defun sq (x) (mult x x))
+(defun h (y) (sq y))
+(defun sq (x) (add x x))
+(print (h 3))
+(defun gz () z)
+(define z 1)
+(defun w () (define z 5) (gz))
+(print (w))
+(defun w2 (n) (defun gz () 99) (gz))
+(print (w2 1))
+(defun sq (x) (mult x x))
+(print (add (sq 2) (sq 3)))
+(dotimes (i 2) (if (eq i 1) (defun sq (x) 0)) (print (sq 4)))
+(defun sq (x) (mult x x))
+(defun redef () (setq sq (lambda (x) -1)))
+(print (and (redef) (sq 3)))
+(defmacro m (x) x)
+(defun f (y) (m y))
+(defmacro m (x) 42)
+(print (f 1))
+(defmacro twice (x) (cons 'add (cons x (cons x ()))))
+(defun tw (y) (twice y))
+(print (add (tw 1) (tw 2)))
+(defmacro twice (x) (cons 'mult (cons x (cons x ()))))
+(print (add (tw 3) (tw 4)))
+(defun k () (add 1 2))
+(define add sub)
+(print (k))
@@ -0,0 +1,14 @@
+; loops that assign their parameters
+(defun sum-to (n acc) (while (lt 0 n) (setq acc (add acc n)) (setq n (sub n 1))) acc)
+(defun pow (b e r) (while (lt 0 e) (setq r (mult r b)) (setq e (sub e 1))) r)
+(defun gcd (a b) (while (if (eq a b) () t) (if (lt a b) (setq b (sub b a)) (setq a (sub a b)))) a)
+(defun collatz (n steps) (while (lt 1 n) (setq steps (add steps 1)) (setq n (if (eq (sub n (mult 2 (half n 0))) 0) (half n 0) (add (mult 3 n) 1)))) steps)
+(defun half (n q) (while (lt 1 n) (setq n (sub n 2)) (setq q (add q 1))) q)
+(print (sum-to 100 0))
+(print (sum-to 0 5))
+(print (pow 3 10 1))
+(print (pow -2 7 1))
+(print (gcd 1071 462))
+(print (gcd 17 5))
+(print (half 9 0))
+(print (collatz 27 0))